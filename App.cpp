@@ -61,9 +61,16 @@ bool executeProgram(const std::string& program_name, const std::string& args = "
     return true; // Indica que la ejecución fue exitosa
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     int choice; // Variable para almacenar la opción del menú elegida por el usuario
 
+    // App.exe --draft: vista previa rapida para revision (imagenes a la mitad de resolucion,
+    // codificacion ultrafast y solo Main_Lesson.mp4)
+    const bool draft = argc > 1 && std::string(argv[1]) == "--draft";
+    if (draft) {
+        std::cout << "Modo borrador: se generara solo una vista previa de Main_Lesson.mp4.\n";
+    }
+
     // Define la ruta a la carpeta "Datos de Videos"
     // ASUMIMOS que App.exe se ejecuta desde MiApp/Librerias/
     // La carpeta "Datos de Videos" está en MiApp/Aplicacion/
@@ -145,11 +152,11 @@ int main() {
                         // Secuencia de ejecución de los programas, deteniéndose si alguno falla
                         // Todos los .exe están en la misma carpeta (MiApp/Librerias/)
                         if (current_video_successful) current_video_successful = executeProgram("obtenerFragmentos.exe");
-                        if (current_video_successful) current_video_successful = executeProgram("imagenes.exe");
+                        if (current_video_successful) current_video_successful = executeProgram("imagenes.exe", draft ? "--draft" : "--rotulos");
                         if (current_video_successful) current_video_successful = executeProgram("generar_nombres_audios.exe");
                         if (current_video_successful) current_video_successful = executeProgram("normalizar_audios.exe");
                         if (current_video_successful) current_video_successful = executeProgram("generar_audios_main.exe");
-                        if (current_video_successful) current_video_successful = executeProgram("generar_videos.exe", project_name); 
+                        if (current_video_successful) current_video_successful = executeProgram("generar_videos.exe", draft ? project_name + " --draft --solo-main" : project_name); 
                     }
                     
                     // Muestra un mensaje final sobre el resultado de este video específico
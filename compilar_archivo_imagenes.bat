@@ -18,11 +18,13 @@ REM --- COMPILACION ---
 echo Compilando imagenes.cpp...
 rem ** Aquí estamos concatenando las rutas de include con las de VCPKG **
 rem ** Añado /std:c++17 para habilitar el soporte de filesystem **
-cl imagenes.cpp /EHsc /std:c++17 ^
+rem ** /O2 optimiza el codigo; con /arch:AVX2 se activa la ruta AVX2 de la mezcla de color **
+rem ** lz4.lib (instalado por vcpkg junto con OpenCV) comprime la cache de frames del modo --stream **
+cl imagenes.cpp /EHsc /std:c++17 /O2 ^
     /I %VCPKG_INCLUDE_PATH% ^
     /I "%VCPKG_INCLUDE_PATH%\opencv4" ^
     /link /LIBPATH:%VCPKG_LIB_PATH% ^
-    opencv_core4.lib opencv_imgcodecs4.lib opencv_highgui4.lib opencv_imgproc4.lib opencv_freetype4.lib ^
+    opencv_core4.lib opencv_imgcodecs4.lib opencv_highgui4.lib opencv_imgproc4.lib opencv_freetype4.lib lz4.lib ^
     /Fe:imagenes.exe
 
 REM Comprobacion si la compilacion fue exitosa
@@ -26,7 +26,8 @@ REM --- COMPILACIÓN ---
 echo.
 echo Compilando image_preprocessor.cpp...
 rem Se añade la bandera /std:c++17 para habilitar las caracteristicas de C++17, como std::filesystem
-cl image_preprocessor.cpp /EHsc /std:c++17 ^
+rem /O2 optimiza el codigo; con /arch:AVX2 se activa la ruta AVX2 de la mezcla de color
+cl image_preprocessor.cpp /EHsc /std:c++17 /O2 ^
     /I %VCPKG_INCLUDE_PATH% ^
     /I "%VCPKG_INCLUDE_PATH%\opencv4" ^
     /link ^
@@ -0,0 +1,752 @@
+#pragma once
+
+// Frame I/O shared by imagenes.cpp and image_preprocessor.cpp: frame formats and the QOI
+// codec, the asynchronous encoder pool, the frame buffer pool, the constant-colour blend
+// kernel, the background cache and the labels drawn over frames. Both programs write the
+// same kind of images, so they share one implementation instead of keeping copies in step.
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/freetype.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "outlined_text.hpp" // compositeOutlinedText, also used by the prueba*.cpp prototypes
+
+// SIMD paths of blendConstantColor. SSE2 is always present on x64; the AVX2 path is
+// compiled in when building with /arch:AVX2 (MSVC) or -mavx2.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Serializes console output from the worker and encoder threads.
+inline std::mutex consoleMutex;
+
+inline void logLine(const std::string& message) {
+    std::lock_guard<std::mutex> lock(consoleMutex);
+    std::cout << message << std::endl;
+}
+
+// File formats for the intermediate frames in imagenes_generadas/. They are read once by
+// the video assembler, so fast lossless codecs pay off over default-level PNG.
+enum class FrameFormat {
+    Png,           // OpenCV PNG encoder
+    Qoi,           // "Quite OK Image" format, encoded here; several times faster than PNG
+    WebpLossless,  // libwebp in lossless mode
+    Bmp            // Uncompressed
+};
+
+inline bool parseFrameFormat(const std::string& name, FrameFormat& format) {
+    if (name == "png") format = FrameFormat::Png;
+    else if (name == "qoi") format = FrameFormat::Qoi;
+    else if (name == "webp") format = FrameFormat::WebpLossless;
+    else if (name == "bmp" || name == "raw") format = FrameFormat::Bmp;
+    else return false;
+    return true;
+}
+
+inline std::string frameExtension(FrameFormat format) {
+    switch (format) {
+        case FrameFormat::Qoi: return ".qoi";
+        case FrameFormat::WebpLossless: return ".webp";
+        case FrameFormat::Bmp: return ".bmp";
+        default: return ".png";
+    }
+}
+
+// Encodes a CV_8UC3 or CV_8UC4 image as QOI (https://qoiformat.org/qoi-specification.pdf).
+// QOI stores RGB(A), so channels are swapped on the way out.
+inline std::vector<cv::uchar> encodeQoi(const cv::Mat& img) {
+    const int width = img.cols, height = img.rows;
+    const int channels = img.channels();
+    std::vector<cv::uchar> out;
+    out.reserve(14 + static_cast<size_t>(width) * height + 8);
+
+    auto put32 = [&](uint32_t v) {
+        out.push_back(static_cast<cv::uchar>(v >> 24)); out.push_back(static_cast<cv::uchar>(v >> 16));
+        out.push_back(static_cast<cv::uchar>(v >> 8)); out.push_back(static_cast<cv::uchar>(v));
+    };
+    out.insert(out.end(), {'q', 'o', 'i', 'f'});
+    put32(static_cast<uint32_t>(width));
+    put32(static_cast<uint32_t>(height));
+    out.push_back(static_cast<cv::uchar>(channels)); // 3 = RGB, 4 = RGBA
+    out.push_back(0); // colorspace: sRGB with linear alpha
+
+    cv::uchar index[64][4] = {};
+    cv::uchar pr = 0, pg = 0, pb = 0, pa = 255;
+    int run = 0;
+    const long long total = static_cast<long long>(width) * height;
+    long long n = 0;
+    for (int y = 0; y < height; ++y) {
+        const cv::uchar* px = img.ptr<cv::uchar>(y);
+        for (int x = 0; x < width; ++x, px += channels, ++n) {
+            cv::uchar r = px[2], g = px[1], b = px[0];
+            cv::uchar a = channels == 4 ? px[3] : 255;
+            if (r == pr && g == pg && b == pb && a == pa) {
+                run++;
+                if (run == 62 || n == total - 1) {
+                    out.push_back(static_cast<cv::uchar>(0xC0 | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                out.push_back(static_cast<cv::uchar>(0xC0 | (run - 1)));
+                run = 0;
+            }
+
+            int slot = (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+            if (index[slot][0] == r && index[slot][1] == g && index[slot][2] == b && index[slot][3] == a) {
+                out.push_back(static_cast<cv::uchar>(slot));
+            } else {
+                index[slot][0] = r; index[slot][1] = g; index[slot][2] = b; index[slot][3] = a;
+                if (a != pa) {
+                    out.push_back(0xFF);
+                    out.push_back(r); out.push_back(g); out.push_back(b); out.push_back(a);
+                } else {
+                    int vr = static_cast<signed char>(r - pr);
+                    int vg = static_cast<signed char>(g - pg);
+                    int vb = static_cast<signed char>(b - pb);
+                    int vg_r = vr - vg;
+                    int vg_b = vb - vg;
+                    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                        out.push_back(static_cast<cv::uchar>(0x40 | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2)));
+                    } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+                        out.push_back(static_cast<cv::uchar>(0x80 | (vg + 32)));
+                        out.push_back(static_cast<cv::uchar>((vg_r + 8) << 4 | (vg_b + 8)));
+                    } else {
+                        out.push_back(0xFE);
+                        out.push_back(r); out.push_back(g); out.push_back(b);
+                    }
+                }
+            }
+            pr = r; pg = g; pb = b; pa = a;
+        }
+    }
+    out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+    return out;
+}
+
+// Decodes a QOI file to CV_8UC3 (BGR), or to CV_8UC4 (BGRA) if it has four channels.
+// Returns an empty Mat if the data is not valid QOI.
+inline cv::Mat decodeQoi(const std::vector<cv::uchar>& data) {
+    if (data.size() < 22 || std::memcmp(data.data(), "qoif", 4) != 0) return cv::Mat();
+    auto get32 = [&](size_t at) {
+        return static_cast<uint32_t>(data[at]) << 24 | static_cast<uint32_t>(data[at + 1]) << 16 |
+               static_cast<uint32_t>(data[at + 2]) << 8 | static_cast<uint32_t>(data[at + 3]);
+    };
+    const uint32_t width = get32(4), height = get32(8);
+    const int channels = data[12] == 4 ? 4 : 3;
+    if (width == 0 || height == 0 || width > 16384 || height > 16384) return cv::Mat();
+
+    cv::Mat img(static_cast<int>(height), static_cast<int>(width), channels == 4 ? CV_8UC4 : CV_8UC3);
+    cv::uchar index[64][4] = {};
+    cv::uchar r = 0, g = 0, b = 0, a = 255;
+    int run = 0;
+    size_t pos = 14;
+    const size_t end = data.size() - 8; // Without the end marker
+    for (int y = 0; y < img.rows; ++y) {
+        cv::uchar* px = img.ptr<cv::uchar>(y);
+        for (int x = 0; x < img.cols; ++x, px += channels) {
+            if (run > 0) {
+                run--;
+            } else if (pos < end) {
+                cv::uchar op = data[pos++];
+                if (op == 0xFE) {
+                    if (pos + 3 > end) return cv::Mat();
+                    r = data[pos]; g = data[pos + 1]; b = data[pos + 2];
+                    pos += 3;
+                } else if (op == 0xFF) {
+                    if (pos + 4 > end) return cv::Mat();
+                    r = data[pos]; g = data[pos + 1]; b = data[pos + 2]; a = data[pos + 3];
+                    pos += 4;
+                } else if ((op & 0xC0) == 0x00) {
+                    r = index[op][0]; g = index[op][1]; b = index[op][2]; a = index[op][3];
+                } else if ((op & 0xC0) == 0x40) {
+                    r += ((op >> 4) & 3) - 2;
+                    g += ((op >> 2) & 3) - 2;
+                    b += (op & 3) - 2;
+                } else if ((op & 0xC0) == 0x80) {
+                    if (pos >= end) return cv::Mat();
+                    int vg = (op & 0x3F) - 32;
+                    cv::uchar second = data[pos++];
+                    r += vg - 8 + (second >> 4);
+                    g += vg;
+                    b += vg - 8 + (second & 0x0F);
+                } else {
+                    run = op & 0x3F;
+                }
+                int slot = (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+                index[slot][0] = r; index[slot][1] = g; index[slot][2] = b; index[slot][3] = a;
+            } else {
+                return cv::Mat(); // Truncated file
+            }
+            px[0] = b; px[1] = g; px[2] = r;
+            if (channels == 4) px[3] = a;
+        }
+    }
+    return img;
+}
+
+// Reads an intermediate frame, keeping the alpha channel of tiles. OpenCV cannot read QOI,
+// so that format is decoded here.
+inline cv::Mat readFrameImage(const std::string& path) {
+    if (std::filesystem::path(path).extension() != ".qoi") {
+        return cv::imread(path, cv::IMREAD_UNCHANGED);
+    }
+    std::ifstream file(path, std::ios::binary);
+    std::vector<cv::uchar> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return decodeQoi(data);
+}
+
+// Fixed-capacity blocking queue. push() blocks while the queue is full, which is what gives the
+// producers backpressure; pop() blocks while it is empty and returns false once the queue has
+// been closed and drained.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(std::max<size_t>(1, capacity)) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mtx);
+        notFull.wait(lock, [&]() { return items.size() < capacity || closed; });
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+    }
+
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mtx);
+        notEmpty.wait(lock, [&]() { return !items.empty() || closed; });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+private:
+    size_t capacity;
+    std::deque<T> items;
+    bool closed = false;
+    std::mutex mtx;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+};
+
+// Encodes and writes images on a pool of encoder threads so that PNG compression and disk I/O
+// overlap with rendering. write() only blocks when `capacity` images are already waiting.
+// Images are shared, not copied: callers must not draw on a Mat after handing it over.
+// With an outputSize (image_preprocessor --draft) the encoder threads scale every image to
+// that size before encoding it.
+class AsyncFrameWriter {
+public:
+    // pngCompression: 0-9, or -1 to keep OpenCV's default settings.
+    AsyncFrameWriter(int encoderThreads, size_t capacity, FrameFormat format, int pngCompression, cv::Size outputSize = cv::Size())
+        : queue(capacity), format(format), outputSize(outputSize) {
+        if (format == FrameFormat::Png && pngCompression >= 0) {
+            encodeParams = {cv::IMWRITE_PNG_COMPRESSION, std::min(pngCompression, 9)};
+        } else if (format == FrameFormat::WebpLossless) {
+            encodeParams = {cv::IMWRITE_WEBP_QUALITY, 101}; // Quality above 100 selects lossless mode
+        }
+        for (int i = 0; i < std::max(1, encoderThreads); ++i) {
+            encoders.emplace_back([this]() { encodeLoop(); });
+        }
+    }
+
+    ~AsyncFrameWriter() { finish(); }
+
+    // Extension of the files this writer produces, including the dot.
+    std::string extension() const { return frameExtension(format); }
+
+    void write(const std::string& path, const cv::Mat& image) {
+        queue.push({path, image});
+    }
+
+    // Waits for every queued image to be written. Returns false if any write failed.
+    bool finish() {
+        queue.close();
+        for (std::thread& t : encoders) {
+            if (t.joinable()) t.join();
+        }
+        return failedWrites == 0;
+    }
+
+private:
+    struct Job {
+        std::string path;
+        cv::Mat image;
+    };
+
+    void encodeLoop() {
+        Job job;
+        while (queue.pop(job)) {
+            bool ok = false;
+            try {
+                ok = encode(job);
+            } catch (const cv::Exception& e) {
+                logLine(std::string("Error de OpenCV al escribir ") + job.path + ": " + e.what());
+            }
+            if (ok) {
+                logLine("✅ Imagen generada: " + job.path);
+            } else {
+                logLine("❌ Error: No se pudo escribir la imagen " + job.path);
+                failedWrites++;
+            }
+            job.image.release();
+        }
+    }
+
+    bool encode(const Job& job) {
+        cv::Mat image = job.image;
+        if (outputSize.area() > 0 && image.size() != outputSize) {
+            cv::resize(job.image, image, outputSize, 0, 0, cv::INTER_AREA);
+        }
+        if (format != FrameFormat::Qoi) {
+            return cv::imwrite(job.path, image, encodeParams);
+        }
+        std::vector<cv::uchar> bytes = encodeQoi(image);
+        std::ofstream file(job.path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        return file.good();
+    }
+
+    BoundedQueue<Job> queue;
+    FrameFormat format;
+    cv::Size outputSize;
+    std::vector<int> encodeParams;
+    std::vector<std::thread> encoders;
+    std::atomic<int> failedWrites{0};
+};
+
+// Recycles frame buffers across frames and threads instead of allocating 6 MB per frame.
+// acquire() hands out an ordinary Mat; the buffer is free again once every header sharing it
+// is gone (the render thread, the encoder queue, the stream queue), which the pool reads from
+// the buffer's reference count. Buffers are kept in one free list per shape, so acquire() only
+// looks at buffers it could hand out, and the free buffers of a shape not requested in the last
+// IDLE_ACQUIRES calls are dropped: a shape in steady use keeps as many buffers as frames in
+// flight, and shapes that come and go (another canvas size) do not pin memory for the whole run.
+class FrameBufferPool {
+public:
+    static constexpr uint64_t IDLE_ACQUIRES = 256;
+
+    // Uninitialized rows x cols buffer of the given type.
+    cv::Mat acquire(int rows, int cols, int type) {
+        std::lock_guard<std::mutex> lock(mtx);
+        ++tick;
+        if (tick % SWEEP_INTERVAL == 0) dropIdleShapes();
+
+        Shape& shape = shapes[std::make_tuple(rows, cols, type)];
+        shape.lastAcquire = tick;
+        for (const cv::Mat& buffer : shape.buffers) {
+            // Only the pool holds it, and only the pool (under this lock) hands out new headers
+            if (CV_XADD(&buffer.u->refcount, 0) == 1) {
+                reused++;
+                return buffer;
+            }
+        }
+        allocated++;
+        shape.buffers.emplace_back(rows, cols, type);
+        return shape.buffers.back();
+    }
+
+    size_t allocatedBuffers() const { std::lock_guard<std::mutex> lock(mtx); return allocated; }
+    size_t reusedBuffers() const { std::lock_guard<std::mutex> lock(mtx); return reused; }
+
+private:
+    static constexpr uint64_t SWEEP_INTERVAL = 64;
+
+    struct Shape {
+        std::deque<cv::Mat> buffers;
+        uint64_t lastAcquire = 0;
+    };
+
+    // Frees the unused buffers of every shape idle for IDLE_ACQUIRES calls. Buffers still held
+    // elsewhere stay until a later sweep finds them free.
+    void dropIdleShapes() {
+        for (auto it = shapes.begin(); it != shapes.end();) {
+            if (tick - it->second.lastAcquire >= IDLE_ACQUIRES) {
+                std::deque<cv::Mat>& buffers = it->second.buffers;
+                buffers.erase(std::remove_if(buffers.begin(), buffers.end(),
+                                             [](const cv::Mat& buffer) { return CV_XADD(&buffer.u->refcount, 0) == 1; }),
+                              buffers.end());
+            }
+            it = it->second.buffers.empty() ? shapes.erase(it) : std::next(it);
+        }
+    }
+
+    mutable std::mutex mtx;
+    std::map<std::tuple<int, int, int>, Shape> shapes;
+    uint64_t tick = 0;
+    size_t allocated = 0;
+    size_t reused = 0;
+};
+
+// Frame buffers of every renderer and store in the process.
+inline FrameBufferPool framePool;
+
+// Blends a constant BGR colour over a CV_8UC3 region in place, in 8.8 fixed point:
+// p = (c*a + p*(256-a) + 128) >> 8 with a = opacity*256. Matches addWeighted to within
+// one level, without the overlay allocation and its extra memory pass.
+inline void blendConstantColor(cv::Mat& roi, const cv::Scalar& color, double opacity) {
+    CV_Assert(roi.type() == CV_8UC3);
+    const int alpha = std::min(256, std::max(0, cvRound(opacity * 256.0)));
+    const int inverse = 256 - alpha;
+    int colorTerm[3]; // c*a + 128 per channel
+    for (int c = 0; c < 3; ++c) {
+        colorTerm[c] = std::min(255, std::max(0, cvRound(color[c]))) * alpha + 128;
+    }
+    const int rowBytes = roi.cols * 3;
+
+#if defined(__AVX2__)
+    // 96 bytes (32 pixels) is the shortest run whose channel pattern fits whole 32-byte
+    // vectors. unpacklo/unpackhi work within 128-bit lanes, so the terms for the low half
+    // are bytes 0-7 and 16-23 of each vector and those for the high half 8-15 and 24-31.
+    __m256i termLo256[3], termHi256[3];
+    for (int k = 0; k < 3; ++k) {
+        alignas(32) uint16_t lo[16], hi[16];
+        for (int i = 0; i < 16; ++i) {
+            int loByte = 32 * k + (i < 8 ? i : i + 8);
+            int hiByte = 32 * k + (i < 8 ? i + 8 : i + 16);
+            lo[i] = static_cast<uint16_t>(colorTerm[loByte % 3]);
+            hi[i] = static_cast<uint16_t>(colorTerm[hiByte % 3]);
+        }
+        termLo256[k] = _mm256_load_si256(reinterpret_cast<const __m256i*>(lo));
+        termHi256[k] = _mm256_load_si256(reinterpret_cast<const __m256i*>(hi));
+    }
+    const __m256i inverse256 = _mm256_set1_epi16(static_cast<short>(inverse));
+    const __m256i zero256 = _mm256_setzero_si256();
+#endif
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    // Same idea with 16-byte vectors: a 48-byte (16 pixel) period.
+    __m128i termLo128[3], termHi128[3];
+    for (int k = 0; k < 3; ++k) {
+        alignas(16) uint16_t lo[8], hi[8];
+        for (int i = 0; i < 8; ++i) {
+            lo[i] = static_cast<uint16_t>(colorTerm[(16 * k + i) % 3]);
+            hi[i] = static_cast<uint16_t>(colorTerm[(16 * k + i + 8) % 3]);
+        }
+        termLo128[k] = _mm_load_si128(reinterpret_cast<const __m128i*>(lo));
+        termHi128[k] = _mm_load_si128(reinterpret_cast<const __m128i*>(hi));
+    }
+    const __m128i inverse128 = _mm_set1_epi16(static_cast<short>(inverse));
+    const __m128i zero128 = _mm_setzero_si128();
+#endif
+
+    for (int y = 0; y < roi.rows; ++y) {
+        cv::uchar* row = roi.ptr<cv::uchar>(y);
+        int x = 0;
+#if defined(__AVX2__)
+        for (; x + 96 <= rowBytes; x += 96) {
+            for (int k = 0; k < 3; ++k) {
+                __m256i* ptr = reinterpret_cast<__m256i*>(row + x + 32 * k);
+                __m256i v = _mm256_loadu_si256(ptr);
+                __m256i lo = _mm256_unpacklo_epi8(v, zero256);
+                __m256i hi = _mm256_unpackhi_epi8(v, zero256);
+                lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(lo, inverse256), termLo256[k]), 8);
+                hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(hi, inverse256), termHi256[k]), 8);
+                _mm256_storeu_si256(ptr, _mm256_packus_epi16(lo, hi));
+            }
+        }
+#endif
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+        for (; x + 48 <= rowBytes; x += 48) {
+            for (int k = 0; k < 3; ++k) {
+                __m128i* ptr = reinterpret_cast<__m128i*>(row + x + 16 * k);
+                __m128i v = _mm_loadu_si128(ptr);
+                __m128i lo = _mm_unpacklo_epi8(v, zero128);
+                __m128i hi = _mm_unpackhi_epi8(v, zero128);
+                lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, inverse128), termLo128[k]), 8);
+                hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, inverse128), termHi128[k]), 8);
+                _mm_storeu_si128(ptr, _mm_packus_epi16(lo, hi));
+            }
+        }
+#endif
+        // x is a multiple of 3 here, so the channel of byte x is x % 3.
+        for (; x < rowBytes; ++x) {
+            row[x] = static_cast<cv::uchar>((row[x] * inverse + colorTerm[x % 3]) >> 8);
+        }
+    }
+}
+
+// Lists the character backgrounds (personajes/<number>.png), sorted by number. Phrases cycle
+// through them in this order; derived files such as 1000_Listening.png are not backgrounds.
+inline std::vector<std::string> listBackgroundImages(const std::string& dir) {
+    std::vector<std::pair<long long, std::string>> found;
+    const std::regex background_name(R"((\d+)\.png)", std::regex_constants::icase);
+    if (std::filesystem::is_directory(dir)) {
+        for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+            std::string name = entry.path().filename().string();
+            std::smatch match;
+            if (entry.is_regular_file() && std::regex_match(name, match, background_name)) {
+                found.push_back({std::stoll(match[1].str()), dir + "/" + name});
+            }
+        }
+    }
+    std::sort(found.begin(), found.end());
+    std::vector<std::string> paths;
+    for (const auto& f : found) paths.push_back(f.second);
+    return paths;
+}
+
+// Decodes every background once per process and canvas size, and hands out read-only views
+// of the result. Callers copy before drawing. Safe to share between render threads: a
+// background is decoded by the first thread that asks for it while the others wait.
+// When the image's aspect ratio differs from the canvas (a landscape character on a vertical
+// short), its centre is cropped to the canvas aspect before resizing, instead of stretching.
+class BackgroundCache {
+public:
+    // Returns the decoded background, or an empty Mat if the image cannot be read.
+    const cv::Mat& get(const std::string& path, cv::Size size) {
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            std::shared_ptr<Entry>& slot = entries[path + "|" + std::to_string(size.width) + "x" + std::to_string(size.height)];
+            if (!slot) slot = std::make_shared<Entry>();
+            entry = slot;
+        }
+        std::call_once(entry->decoded, [&]() {
+            cv::Mat image = cv::imread(path);
+            if (!image.empty()) {
+                double imageAspect = static_cast<double>(image.cols) / image.rows;
+                double canvasAspect = static_cast<double>(size.width) / size.height;
+                if (std::abs(imageAspect - canvasAspect) > 0.01 * canvasAspect) {
+                    cv::Rect crop = imageAspect > canvasAspect
+                        ? cv::Rect(0, 0, static_cast<int>(std::lround(image.rows * canvasAspect)), image.rows)
+                        : cv::Rect(0, 0, image.cols, static_cast<int>(std::lround(image.cols / canvasAspect)));
+                    crop.x = (image.cols - crop.width) / 2;
+                    crop.y = (image.rows - crop.height) / 2;
+                    image = image(crop);
+                }
+                cv::resize(image, image, size, 0, 0, cv::INTER_LINEAR);
+            }
+            entry->image = image;
+        });
+        return entry->image;
+    }
+
+private:
+    struct Entry {
+        std::once_flag decoded;
+        cv::Mat image;
+    };
+    std::mutex mtx;
+    std::map<std::string, std::shared_ptr<Entry>> entries;
+};
+
+// --- Labels ---
+// Translucent boxes with outlined text stamped over frames and backgrounds. image_preprocessor
+// draws them on its Listening and Test images and imagenes --rotulos on the English-only and
+// English+Spanish frames; both go through the code below, so a style change here reaches every
+// labelled image. Sizes are for a 1920x1080 image.
+
+const cv::Scalar COLOR_RECTANGULO_CELESTE_AZULADO = cv::Scalar(255, 175, 80);
+const cv::Scalar COLOR_RECTANGULO_VERDE_CLARO = cv::Scalar(120, 255, 120);
+const cv::Scalar COLOR_TEXTO_BLANCO = cv::Scalar(255, 255, 255);
+const cv::Scalar COLOR_TEXTO_OUTLINE_NEGRO = cv::Scalar(0, 0, 0);
+
+const double RECTANGLE_OPACITY_LISTENING_SUBTITLES = 0.75;
+const double RECTANGLE_OPACITY_TEST = 0.70;
+
+const int MARGIN_TOP_DEFAULT = 30;    // Labels at the top of the image
+const int MARGIN_BOTTOM_DEFAULT = 30; // Labels at the bottom of the image
+const int MARGIN_SIDES_DEFAULT = 30;  // Both sides
+const int SPACING_BETWEEN_TEST_RECTS = 20; // Between the two boxes of the Test image
+
+// Padding of the text inside its box
+const int PADDING_VERTICAL_LISTENING = 30;
+const int PADDING_HORIZONTAL_LISTENING = 50;
+const int PADDING_VERTICAL_SUBTITLES = 30;
+const int PADDING_HORIZONTAL_SUBTITLES = 50;
+const int PADDING_VERTICAL_TEST_BLUE = 30;
+const int PADDING_HORIZONTAL_TEST_BLUE = 50;
+const int PADDING_VERTICAL_TEST_GREEN = 15;
+const int PADDING_HORIZONTAL_TEST_GREEN = 25;
+
+const int FONT_HEIGHT_LISTENING = 120;
+const int FONT_HEIGHT_SUBTITLES_EN_ES = 75;
+const int FONT_HEIGHT_SUBTITLES_EN = 80;
+const int FONT_HEIGHT_TEST_BLUE = 100;
+const int FONT_HEIGHT_TEST_GREEN = 70;
+
+const int OUTLINE_THICKNESS = 4;
+
+const std::string TEXTO_LISTENING = "Escucha sin Subtítulos";
+const std::string TEXTO_TEST_AZUL = "¿Sientes que has mejorado?";
+const std::string TEXTO_TEST_VERDE = "Cuéntamelo en los comentarios";
+const std::string TEXTO_SUBTITULOS_EN = "Escucha con subtítulos en Inglés";
+const std::string TEXTO_SUBTITULOS_EN_ES = "Escucha con subtítulos en Inglés y Español";
+
+// Splits label text into lines no wider than maxWidth.
+inline std::vector<std::string> wrapLabelText(cv::Ptr<cv::freetype::FreeType2> ft2, const std::string& text, int fontHeight, int maxWidth) {
+    std::vector<std::string> lines;
+    std::stringstream ss(text);
+    std::string word;
+    std::string currentLine;
+    while (ss >> word) {
+        std::string testLine = currentLine.empty() ? word : currentLine + " " + word;
+        if (ft2->getTextSize(testLine, fontHeight, -1, nullptr).width <= maxWidth || currentLine.empty()) {
+            currentLine = testLine;
+        } else {
+            lines.push_back(currentLine);
+            currentLine = word;
+        }
+    }
+    if (!currentLine.empty()) {
+        lines.push_back(currentLine);
+    }
+    return lines;
+}
+
+// Height of the wrapped label text: one "Tg" line height per line.
+inline int labelTextHeight(cv::Ptr<cv::freetype::FreeType2> ft2, const std::string& text, int fontHeight, int maxWidth) {
+    const size_t lines = wrapLabelText(ft2, text, fontHeight, maxWidth).size();
+    if (lines == 0) return 0;
+    return static_cast<int>(lines) * ft2->getTextSize("Tg", fontHeight, -1, nullptr).height;
+}
+
+// Draws wrapped text with an outline, centred horizontally and vertically inside rect.
+inline void drawWrappedTextWithOutline(cv::Mat& img, cv::Ptr<cv::freetype::FreeType2> ft2, const std::string& text, const cv::Rect& rect,
+                                       int fontHeight, const cv::Scalar& textColor, const cv::Scalar& outlineColor,
+                                       int outlineThickness, int horizontalPadding, int verticalPadding) {
+    const int textAreaWidth = rect.width - 2 * horizontalPadding;
+    std::vector<std::string> lines = wrapLabelText(ft2, text, fontHeight, textAreaWidth);
+    if (lines.empty()) return;
+
+    const int lineHeight = ft2->getTextSize("Tg", fontHeight, -1, nullptr).height;
+    const int textHeight = static_cast<int>(lines.size()) * lineHeight;
+    int lineTop = rect.y + verticalPadding + (rect.height - 2 * verticalPadding - textHeight) / 2;
+
+    // One coverage mask for every line, with room for the outline. It spans the rect plus
+    // whatever a line draws outside it (a word wider than the rect), with half a font height
+    // at the sides for glyphs that overhang getTextSize's box, and is clipped only to the image.
+    std::vector<cv::Point> origins;
+    cv::Rect area(rect.x - outlineThickness, rect.y - outlineThickness, rect.width + 2 * outlineThickness, rect.height + 2 * outlineThickness);
+    for (const std::string& line : lines) {
+        const int lineWidth = ft2->getTextSize(line, fontHeight, -1, nullptr).width;
+        const cv::Point origin(rect.x + horizontalPadding + (textAreaWidth - lineWidth) / 2, lineTop + lineHeight);
+        origins.push_back(origin);
+        area |= cv::Rect(origin.x - fontHeight / 2 - outlineThickness, origin.y - fontHeight - outlineThickness,
+                         lineWidth + fontHeight + 2 * outlineThickness, fontHeight * 3 / 2 + 2 * outlineThickness);
+        lineTop += lineHeight;
+    }
+    area &= cv::Rect(0, 0, img.cols, img.rows);
+    if (area.empty()) return;
+
+    // Drawn on three channels because FreeType's putText does not take single-channel images
+    // in every OpenCV version.
+    cv::Mat coverageBgr = cv::Mat::zeros(area.size(), CV_8UC3);
+    for (size_t i = 0; i < lines.size(); ++i) {
+        ft2->putText(coverageBgr, lines[i], origins[i] - area.tl(), fontHeight, cv::Scalar::all(255), -1, cv::LINE_AA, true);
+    }
+    cv::Mat coverage;
+    cv::extractChannel(coverageBgr, coverage, 0);
+    cv::Mat roi = img(area);
+    compositeOutlinedText(roi, coverage, textColor, outlineColor, outlineThickness);
+}
+
+// Draws the subtitle label (translucent box with the outlined text) at the top of img. Sizes
+// are scaled from 1080 pixels to the shorter side of img.
+inline void drawSubtitleLabel(cv::Mat& img, cv::Ptr<cv::freetype::FreeType2> ft2, const std::string& text, int baseFontHeight) {
+    const double scale = std::min(img.cols, img.rows) / 1080.0;
+    auto scaled = [&](int value) { return static_cast<int>(std::lround(value * scale)); };
+    const int fontHeight = scaled(baseFontHeight);
+    const int margin = scaled(MARGIN_SIDES_DEFAULT);
+    const int paddingH = scaled(PADDING_HORIZONTAL_SUBTITLES);
+    const int paddingV = scaled(PADDING_VERTICAL_SUBTITLES);
+    const int outline = std::max(1, scaled(OUTLINE_THICKNESS));
+
+    const int maxTextWidth = img.cols - 2 * margin - 2 * paddingH;
+    int textWidth = 0;
+    for (const std::string& line : wrapLabelText(ft2, text, fontHeight, maxTextWidth)) {
+        textWidth = std::max(textWidth, ft2->getTextSize(line, fontHeight, -1, nullptr).width);
+    }
+    const int textHeight = labelTextHeight(ft2, text, fontHeight, maxTextWidth);
+
+    const int rectWidth = std::min(textWidth + 2 * paddingH, img.cols - 2 * margin);
+    const cv::Rect labelRect((img.cols - rectWidth) / 2, scaled(MARGIN_TOP_DEFAULT), rectWidth, textHeight + 2 * paddingV);
+    cv::Mat box = img(labelRect);
+    blendConstantColor(box, COLOR_RECTANGULO_CELESTE_AZULADO, RECTANGLE_OPACITY_LISTENING_SUBTITLES);
+    drawWrappedTextWithOutline(img, ft2, text, labelRect, fontHeight, COLOR_TEXTO_BLANCO, COLOR_TEXTO_OUTLINE_NEGRO, outline, paddingH, paddingV);
+}
+
+// A label as a premultiplied BGRA sprite, cropped to its visible pixels.
+struct LabelSprite {
+    cv::Mat bgra;     // Colour already multiplied by alpha
+    cv::Point origin; // Top-left corner in the image
+};
+
+// Full-size premultiplied BGRA image of whatever `draw` puts on an image of the given size.
+// Drawn once over black and once over white: the black pass is the premultiplied colour and
+// the difference between the two is 255 * (1 - alpha).
+inline cv::Mat renderLabelBgra(cv::Size size, const std::function<void(cv::Mat&)>& draw) {
+    cv::Mat onBlack(size, CV_8UC3, cv::Scalar::all(0));
+    cv::Mat onWhite(size, CV_8UC3, cv::Scalar::all(255));
+    draw(onBlack);
+    draw(onWhite);
+
+    cv::Mat bgra(size, CV_8UC4);
+    for (int y = 0; y < size.height; ++y) {
+        const cv::uchar* black = onBlack.ptr<cv::uchar>(y);
+        const cv::uchar* white = onWhite.ptr<cv::uchar>(y);
+        cv::uchar* out = bgra.ptr<cv::uchar>(y);
+        for (int x = 0; x < size.width; ++x, black += 3, white += 3, out += 4) {
+            const int alpha = 255 - (white[0] - black[0] + white[1] - black[1] + white[2] - black[2] + 1) / 3;
+            for (int c = 0; c < 3; ++c) out[c] = static_cast<cv::uchar>(std::min<int>(black[c], alpha));
+            out[3] = static_cast<cv::uchar>(alpha);
+        }
+    }
+    return bgra;
+}
+
+// Crops a full-size premultiplied BGRA label to the pixels with non-zero alpha.
+inline LabelSprite cropLabelSprite(const cv::Mat& bgra) {
+    cv::Mat alpha;
+    cv::extractChannel(bgra, alpha, 3);
+    const cv::Rect bounds = cv::boundingRect(alpha);
+    return {bgra(bounds).clone(), bounds.tl()};
+}
+
+// Composites a premultiplied sprite over a CV_8UC3 image in place: p = s + p*(255-a)/255.
+inline void compositeSprite(cv::Mat& image, const LabelSprite& sprite) {
+    cv::Mat roi = image(cv::Rect(sprite.origin, sprite.bgra.size()));
+    for (int y = 0; y < roi.rows; ++y) {
+        cv::uchar* pixel = roi.ptr<cv::uchar>(y);
+        const cv::uchar* source = sprite.bgra.ptr<cv::uchar>(y);
+        for (int x = 0; x < roi.cols; ++x, pixel += 3, source += 4) {
+            const int inverse = 255 - source[3];
+            if (inverse == 255) continue;
+            for (int c = 0; c < 3; ++c) {
+                pixel[c] = static_cast<cv::uchar>(source[c] + (pixel[c] * inverse + 127) / 255);
+            }
+        }
+    }
+}
@@ -9,6 +9,7 @@
 #include <filesystem>
 #include <numeric>
 #include <memory>
+#include <map>
 #include <cstdio> // For _popen, _pclose
 
 using namespace std;
@@ -86,6 +87,102 @@ IndicesData read_indices_file(const std::string& filename) {
     return data;
 }
 
+// Manifiesto de frames escrito por imagenes.exe (numero_frame|archivo|hash por linea).
+// Varios frames pueden apuntar al mismo archivo, ya que cada imagen distinta se guarda una sola vez.
+// En modo teselas (cabecera "#teselas|fila") el archivo es una tesela RGBA de la parte inferior
+// y la linea lleva un cuarto campo con el fondo sobre el que se superpone.
+// La cabecera "#rotulos|1" indica que imagenes.exe --rotulos ya escribio las imagenes con el
+// rotulo de subtitulos (Imagenes_English e Imagenes_Spanish).
+struct FrameManifest {
+    std::map<int, std::string> files;        // numero de frame -> ruta del archivo
+    std::map<int, std::string> backgrounds;  // numero de frame -> ruta del fondo (modo teselas)
+    int tile_y = -1;                         // -1 = frames completos
+    bool labels = false;                     // Imagenes con rotulo escritas por imagenes.exe
+};
+
+FrameManifest read_frame_manifest(const std::string& frames_dir) {
+    FrameManifest manifest;
+    std::ifstream file(frames_dir + "/manifiesto_frames.txt");
+    if (!file.is_open()) {
+        return manifest; // Sin manifiesto: se usa la convencion antigua {indice}.png
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::stringstream ss(line);
+        std::string frame_number, file_name, hash, background;
+        if (!std::getline(ss, frame_number, '|') || !std::getline(ss, file_name, '|')) continue;
+        try {
+            if (frame_number == "#teselas") {
+                manifest.tile_y = std::stoi(file_name);
+                continue;
+            }
+            if (frame_number == "#rotulos") {
+                manifest.labels = file_name == "1";
+                continue;
+            }
+            int number = std::stoi(frame_number);
+            manifest.files[number] = frames_dir + "/" + file_name;
+            if (std::getline(ss, hash, '|') && std::getline(ss, background, '|') && !background.empty()) {
+                manifest.backgrounds[number] = frames_dir + "/" + background;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Advertencia: Linea invalida en el manifiesto de frames: " << line << std::endl;
+        }
+    }
+    return manifest;
+}
+
+// Devuelve la ruta del archivo de un frame segun el manifiesto, o {indice}.png si no aparece en el.
+std::string frame_path(const FrameManifest& manifest, const std::string& frames_dir, int frame_number) {
+    auto it = manifest.files.find(frame_number);
+    if (it != manifest.files.end()) return it->second;
+    return frames_dir + "/" + std::to_string(frame_number) + ".png";
+}
+
+// Fondo sobre el que se superpone la tesela de un frame (vacio si el frame es completo).
+std::string frame_background(const FrameManifest& manifest, int frame_number) {
+    auto it = manifest.backgrounds.find(frame_number);
+    return it != manifest.backgrounds.end() ? it->second : std::string();
+}
+
+// Frames de imagenes.exe que forman un video, ademas de sus rutas: en modo teselas el fondo
+// bajo cada imagen (superpuesta en la fila tile_y) y en modo streaming el numero de cada frame,
+// que imagenes.exe --stream renderiza y envia a ffmpeg sin pasar por archivos.
+struct RenderedFrames {
+    std::vector<std::string> backgrounds;
+    int tile_y = -1;
+    std::vector<int> numbers;
+    bool streaming = false;
+
+    bool tiles_active() const { return tile_y >= 0 && !backgrounds.empty(); }
+    bool streaming_active() const { return streaming && !numbers.empty(); }
+};
+
+const int STREAM_FPS = 25; // Cuadros por segundo de los videos generados por streaming
+
+// Ajustes del codificador de video. --draft los cambia por una vista previa rapida: preset
+// ultrafast, mas compresion y pocos cuadros por segundo (las imagenes son fijas durante cada
+// audio, asi que solo se pierde precision en los cambios de imagen).
+struct VideoEncoding {
+    std::string x264_args = "-c:v libx264 -preset fast -crf 22";
+    int fps = 0;  // 0 = la que decida ffmpeg (STREAM_FPS en streaming)
+    bool draft = false;
+    bool yuv_stream = false; // En streaming, imagenes.exe envia los frames ya en 4:2:0 (y4m)
+
+    std::string output_rate() const { return fps > 0 ? " -r " + std::to_string(fps) : ""; }
+};
+VideoEncoding video_encoding;
+
+// En modo streaming los videos no se codifican uno a uno: cada uno deja su trabajo y su audio en
+// STREAM_PENDING_DIR y al final un solo imagenes.exe --stream los codifica todos. Asi los frames
+// que comparten (los de los videos de subtitulos aparecen tambien en Main_Lesson) se renderizan
+// una vez y pasan de un video a otro comprimidos en memoria, sin escribirse como imagenes.
+const std::string STREAM_PENDING_DIR = "Streaming_Pendiente";
+std::vector<std::string> pending_stream_jobs;   // Trabajos en el orden de los videos
+std::vector<std::string> pending_stream_videos; // Ruta de cada video, para el resumen final
+int stream_memory_mb = 0; // Memoria de la cache de frames de imagenes.exe (0 = su valor por defecto)
+
 // Clase utilitaria para gestionar archivos temporales. Asegura que se eliminen al salir del alcance.
 class TempFile {
     std::string filename;
@@ -223,7 +320,8 @@ void generate_final_video_from_lists(
     const std::vector<std::string>& audios_to_process_final,
     const std::vector<std::string>& images_to_process_final,
     const fs::path& base_output_video_dir, // Nuevo argumento para la ruta base de salida de videos
-    const std::string& audio_preparation_output_dir_optional = ""
+    const std::string& audio_preparation_output_dir_optional = "",
+    const RenderedFrames& frames = RenderedFrames() // Teselas o streaming de los frames de imagenes.exe
 ) {
     // La carpeta de salida de audios temporal estará dentro de la carpeta Librerias (directorio actual)
     const std::string output_audio_dir = "Audios_Generados_Temporales"; 
@@ -266,31 +364,98 @@ void generate_final_video_from_lists(
     }
     exec_command("ffmpeg -y -f concat -safe 0 -i " + list_audio_final.path() + " -c copy \"" + final_output_audio_path + "\"");
 
-    std::cout << "\nPreparando lista de imagenes para el video (" << video_name_val << ")..." << std::endl;
-    TempFile list_images_final("images_list_final.txt"); // Archivo temporal para la lista de imágenes
-    {
-        std::ofstream img_out(list_images_final.path());
-        for (size_t i = 0; i < bloques_audio_final_concat.size(); ++i) {
-            float duration = get_audio_duration(bloques_audio_final_concat[i]);
-            if (!fs::exists(images_to_process_final[i])) {
-                std::cerr << "Error: La imagen " << images_to_process_final[i] << " no existe. Asegurese de que las imagenes esten generadas y en la ruta correcta." << std::endl;
-                exit(EXIT_FAILURE); // Sale si una imagen no se encuentra
+    if (frames.streaming_active()) {
+        // imagenes.exe renderiza los frames y los envia por una tuberia a ffmpeg, cada uno
+        // durante lo que dura su bloque de audio; no se escribe ni se lee ninguna imagen.
+        std::cout << "\nPreparando trabajo de streaming para el video (" << video_name_val << ")..." << std::endl;
+        // El audio sale de la carpeta temporal, que se borra al terminar esta funcion
+        fs::create_directories(STREAM_PENDING_DIR);
+        const std::string base_name = video_name_val.substr(0, video_name_val.find_last_of('.'));
+        const std::string job_audio_path = STREAM_PENDING_DIR + "/" + base_name + "_audio.mp3";
+        const std::string job_path = STREAM_PENDING_DIR + "/" + base_name + "_trabajo.txt";
+        fs::rename(final_output_audio_path, job_audio_path);
+        {
+            std::ofstream job(job_path);
+            job << "fps|" << (video_encoding.fps > 0 ? video_encoding.fps : STREAM_FPS) << "\n";
+            job << "ffmpeg|-i \"" << job_audio_path << "\" -map 0:v:0 -map 1:a:0 " << video_encoding.x264_args << " -pix_fmt yuv420p -c:a aac -shortest \"" << final_output_video_path << "\"\n";
+            size_t count = std::min(bloques_audio_final_concat.size(), frames.numbers.size());
+            for (size_t i = 0; i < count; ++i) {
+                job << "frame|" << frames.numbers[i] << "|" << get_audio_duration(bloques_audio_final_concat[i]) << "\n";
             }
-            img_out << "file '" << images_to_process_final[i] << "'\n";
-            img_out << "duration " << duration << "\n";
         }
-        // Añade la última imagen para asegurar que el video no se corte si el último audio es muy corto
-        if (!images_to_process_final.empty()) {
-            img_out << "file '" << images_to_process_final.back() << "'\n";
+        pending_stream_jobs.push_back(job_path);
+        pending_stream_videos.push_back(final_output_video_path);
+        std::cout << "Video " << video_name_val << " en cola: se codificara por streaming con los demas videos del proyecto." << std::endl;
+    } else {
+        std::cout << "\nPreparando lista de imagenes para el video (" << video_name_val << ")..." << std::endl;
+        TempFile list_images_final("images_list_final.txt"); // Archivo temporal para la lista de imágenes
+        TempFile list_backgrounds_final("backgrounds_list_final.txt"); // Fondos bajo las teselas (modo teselas)
+        const bool tile_mode = frames.tiles_active();
+        {
+            std::ofstream img_out(list_images_final.path());
+            std::ofstream background_out;
+            if (tile_mode) background_out.open(list_backgrounds_final.path());
+
+            // Los frames consecutivos que comparten archivo (repeticiones) se funden en una sola
+            // entrada con la suma de sus duraciones, para que ffmpeg decodifique la imagen una vez.
+            // En modo teselas ambas listas se agrupan igual para que sigan sincronizadas.
+            auto background_at = [&](size_t i) {
+                return tile_mode && i < frames.backgrounds.size() ? frames.backgrounds[i] : std::string();
+            };
+            auto emit = [&](const std::string& image, const std::string& background, float duration) {
+                img_out << "file '" << image << "'\n";
+                img_out << "duration " << duration << "\n";
+                if (tile_mode) {
+                    background_out << "file '" << background << "'\n";
+                    background_out << "duration " << duration << "\n";
+                }
+            };
+            std::string pending_image, pending_background;
+            float pending_duration = 0.0f;
+            for (size_t i = 0; i < bloques_audio_final_concat.size(); ++i) {
+                float duration = get_audio_duration(bloques_audio_final_concat[i]);
+                if (!fs::exists(images_to_process_final[i])) {
+                    std::cerr << "Error: La imagen " << images_to_process_final[i] << " no existe. Asegurese de que las imagenes esten generadas y en la ruta correcta." << std::endl;
+                    exit(EXIT_FAILURE); // Sale si una imagen no se encuentra
+                }
+                if (images_to_process_final[i] == pending_image && background_at(i) == pending_background) {
+                    pending_duration += duration;
+                    continue;
+                }
+                if (!pending_image.empty()) {
+                    emit(pending_image, pending_background, pending_duration);
+                }
+                pending_image = images_to_process_final[i];
+                pending_background = background_at(i);
+                pending_duration = duration;
+            }
+            if (!pending_image.empty()) {
+                emit(pending_image, pending_background, pending_duration);
+            }
+            // Añade la última imagen para asegurar que el video no se corte si el último audio es muy corto
+            if (!images_to_process_final.empty()) {
+                img_out << "file '" << images_to_process_final.back() << "'\n";
+                if (tile_mode) background_out << "file '" << background_at(images_to_process_final.size() - 1) << "'\n";
+            }
         }
-    }
 
-    std::cout << "\nGenerando video final: " << video_name_val << "..." << std::endl;
-    std::string final_cmd = "ffmpeg -y -f concat -safe 0 -i " + list_images_final.path() +
-                             " -i \"" + final_output_audio_path +
-                             "\" -map 0:v:0 -map 1:a:0 -c:v libx264 -preset fast -crf 22 -pix_fmt yuv420p -c:a aac -shortest \"" + final_output_video_path + "\"";
+        std::cout << "\nGenerando video final: " << video_name_val << "..." << std::endl;
+        std::string final_cmd;
+        if (tile_mode) {
+            // Los fondos (entrada 0) y las teselas RGBA (entrada 1) se componen al codificar.
+            final_cmd = "ffmpeg -y -f concat -safe 0 -i " + list_backgrounds_final.path() +
+                        " -f concat -safe 0 -i " + list_images_final.path() +
+                        " -i \"" + final_output_audio_path +
+                        "\" -filter_complex \"[0:v][1:v]overlay=0:" + std::to_string(frames.tile_y) + ":format=auto,format=yuv420p[v]\"" +
+                        " -map \"[v]\" -map 2:a:0 " + video_encoding.x264_args + video_encoding.output_rate() + " -c:a aac -shortest \"" + final_output_video_path + "\"";
+        } else {
+            final_cmd = "ffmpeg -y -f concat -safe 0 -i " + list_images_final.path() +
+                        " -i \"" + final_output_audio_path +
+                        "\" -map 0:v:0 -map 1:a:0 " + video_encoding.x264_args + video_encoding.output_rate() + " -pix_fmt yuv420p -c:a aac -shortest \"" + final_output_video_path + "\"";
+        }
 
-    exec_command(final_cmd);
+        exec_command(final_cmd);
+    }
     
     std::cout << "\nEliminando archivos temporales de audio y listas para " << video_name_val << "..." << std::endl;
     int temp_deleted = 0;
@@ -320,7 +485,34 @@ void generate_final_video_from_lists(
         }
     }
 
-    std::cout << "\n✅ Video " << video_name_val << " generado exitosamente: " << final_output_video_path << std::endl;
+    if (!frames.streaming_active()) {
+        std::cout << "\n✅ Video " << video_name_val << " generado exitosamente: " << final_output_video_path << std::endl;
+    }
+}
+
+// Codifica en una sola ejecucion de imagenes.exe --stream los videos que quedaron en cola.
+void run_pending_stream_jobs() {
+    if (pending_stream_jobs.empty()) return;
+    std::string command = "imagenes.exe";
+    for (const std::string& job : pending_stream_jobs) {
+        command += " --stream " + job;
+    }
+    if (video_encoding.draft) command += " --draft";
+    if (video_encoding.yuv_stream) command += " --yuv";
+    if (stream_memory_mb > 0) command += " --memoria-mb " + std::to_string(stream_memory_mb);
+    std::cout << "\nGenerando " << pending_stream_jobs.size() << " video(s) por streaming..." << std::endl;
+    exec_command(command);
+
+    try {
+        fs::remove_all(STREAM_PENDING_DIR);
+    } catch (const fs::filesystem_error& e) {
+        std::cerr << "Error al eliminar la carpeta de trabajos de streaming " << STREAM_PENDING_DIR << ": " << e.what() << "\n";
+    }
+    for (const std::string& video : pending_stream_videos) {
+        std::cout << "✅ Video generado exitosamente: " << video << std::endl;
+    }
+    pending_stream_jobs.clear();
+    pending_stream_videos.clear();
 }
 
 
@@ -328,12 +520,55 @@ int main(int argc, char* argv[]) {
     // El programa ahora espera el nombre de la carpeta del proyecto como argumento
     if (argc < 2) {
         std::cerr << "Error: Se requiere el nombre de la carpeta del proyecto de video como argumento.\n";
-        std::cerr << "Uso: " << argv[0] << " <nombre_carpeta_proyecto_video>\n";
+        std::cerr << "Uso: " << argv[0] << " <nombre_carpeta_proyecto_video> [--formato png|qoi|webp|bmp] [--streaming [--yuv] [--memoria-mb N]] [--draft] [--solo-main]\n";
         std::cerr << "Ejemplo: " << argv[0] << " Vid0001\n";
         return EXIT_FAILURE;
     }
 
     std::string video_project_folder_name = argv[1]; // Captura el nombre de la carpeta del proyecto
+
+    // Formato de las imagenes intermedias del preprocesador. Debe coincidir con el usado en
+    // imagenes.exe solo por rendimiento: las rutas de sus frames vienen del manifiesto.
+    // QOI requiere ffmpeg 5.1 o posterior para el demuxer concat.
+    std::string frame_format = "png";
+    bool streaming = false; // Los frames de imagenes.exe se renderizan al codificar (imagenes.exe --stream)
+    bool solo_main = false; // Solo se genera Main_Lesson.mp4 (revision rapida)
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--formato" && i + 1 < argc) {
+            frame_format = argv[++i];
+        } else if (arg == "--streaming") {
+            streaming = true;
+        } else if (arg == "--yuv") {
+            video_encoding.yuv_stream = true;
+        } else if (arg == "--memoria-mb" && i + 1 < argc) {
+            stream_memory_mb = std::atoi(argv[++i]);
+        } else if (arg == "--draft") {
+            video_encoding.draft = true;
+        } else if (arg == "--solo-main") {
+            solo_main = true;
+        } else {
+            std::cerr << "Error: Argumento desconocido '" << arg << "'.\n";
+            return EXIT_FAILURE;
+        }
+    }
+    if (frame_format == "raw") frame_format = "bmp";
+    if (frame_format != "png" && frame_format != "qoi" && frame_format != "webp" && frame_format != "bmp") {
+        std::cerr << "Error: '--formato' espera png, qoi, webp o bmp.\n";
+        return EXIT_FAILURE;
+    }
+    const std::string frame_extension = "." + frame_format;
+    if ((video_encoding.yuv_stream || stream_memory_mb > 0) && !streaming) {
+        std::cerr << "Error: '--yuv' y '--memoria-mb' solo se usan con '--streaming'.\n";
+        return EXIT_FAILURE;
+    }
+    if (video_encoding.draft) {
+        // Vista previa para revision: imagenes.exe e image_preprocessor.exe --draft generan
+        // las imagenes a la mitad de ancho y alto.
+        video_encoding.x264_args = "-c:v libx264 -preset ultrafast -crf 30";
+        video_encoding.fps = 10;
+        std::cout << "Modo borrador: videos de vista previa (ultrafast, " << video_encoding.fps << " fps).\n";
+    }
     std::cout << "Iniciando generacion de videos para el proyecto: '" << video_project_folder_name << "'\n";
 
     // Define la ruta base para los videos generados específicos de este proyecto
@@ -347,18 +582,37 @@ int main(int argc, char* argv[]) {
     
     // Ejecutar el preprocesador de imágenes (image_preprocessor.exe)
     // Este se ejecuta desde MiApp/Librerias/ y asume que está en el mismo nivel
-    std::cout << "Ejecutando el preprocesador de imagenes (image_preprocessor.exe) para preparar los fondos y las imagenes de subtitulos..." << std::endl;
-    // Puesto que image_preprocessor.exe limpia su propia carpeta de salida (imagenes_generadas), no necesitamos limpiar antes.
-    int preprocessor_ret = std::system("image_preprocessor.exe");
-    if (preprocessor_ret != 0) {
-        std::cerr << "Error: El preprocesador de imagenes (image_preprocessor.exe) no pudo ejecutarse correctamente o salio con un error. Por favor, asegurese de que este compilado y accesible, y que la fuente 'Montserrat-Bold.ttf' y las imagenes base ('personajes/1000.png', 'personajes/2000.png') esten en sus ubicaciones correctas." << std::endl;
-        return EXIT_FAILURE;
+    // Main_Lesson solo usa los frames de imagenes.exe, asi que --solo-main no lo necesita.
+    if (!solo_main) {
+        std::cout << "Ejecutando el preprocesador de imagenes (image_preprocessor.exe) para preparar los fondos y las imagenes de subtitulos..." << std::endl;
+        // Puesto que image_preprocessor.exe limpia su propia carpeta de salida (imagenes_generadas), no necesitamos limpiar antes.
+        // Si imagenes.exe ya escribio las imagenes con rotulo, el preprocesador solo genera los fondos
+        const bool labels_rendered = read_frame_manifest("imagenes_generadas").labels;
+        int preprocessor_ret = std::system(("image_preprocessor.exe --formato " + frame_format + (video_encoding.draft ? " --draft" : "")
+                                            + (labels_rendered ? " --solo-fondos" : "")).c_str());
+        if (preprocessor_ret != 0) {
+            std::cerr << "Error: El preprocesador de imagenes (image_preprocessor.exe) no pudo ejecutarse correctamente o salio con un error. Por favor, asegurese de que este compilado y accesible, y que la fuente 'Montserrat-Bold.ttf' y las imagenes base ('personajes/1000.png', 'personajes/2000.png') esten en sus ubicaciones correctas." << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "✅ Preprocesamiento de imagenes completado." << std::endl;
     }
-    std::cout << "✅ Preprocesamiento de imagenes completado." << std::endl;
 
 
     // Lee los índices de las imágenes generadas por image_preprocessor.exe
     IndicesData indices = read_indices_file("IndicesImagenes.txt");
+    // Manifiesto de imagenes.exe: numero de frame -> archivo con sus pixeles
+    // En modo streaming no se usan los archivos de imagenes_generadas (pueden ser de otra ejecucion)
+    const FrameManifest frame_manifest = streaming ? FrameManifest() : read_frame_manifest("imagenes_generadas");
+    RenderedFrames rendered_frames; // Fondos (modo teselas) y numeros (streaming) de los frames de cada video
+    rendered_frames.tile_y = frame_manifest.tile_y;
+    rendered_frames.streaming = streaming;
+    if (streaming) {
+        std::error_code ec;
+        fs::remove_all(STREAM_PENDING_DIR, ec); // Trabajos de una ejecucion anterior interrumpida
+    }
+    if (rendered_frames.tile_y >= 0) {
+        std::cout << "Modo teselas: las imagenes de imagenes_generadas se superponen en la fila " << rendered_frames.tile_y << ".\n";
+    }
 
     float silence_duration;
     string video_name;
@@ -371,114 +625,123 @@ int main(int argc, char* argv[]) {
     auto all_dialogue_audios = list_files_sorted(dialogue_audio_base_path, R"(en\d+\.mp3)");
     
     const string personajes_path = "personajes"; // Carpeta personajes en Librerias/
+    // Fondos de personajes (personajes/<numero>.png); las frases los recorren en orden ciclico
+    auto background_images = list_files_sorted(personajes_path, R"(\d+\.png)");
+    auto background_variant = [&](int phrase_index, const std::string& suffix) {
+        const std::string& base = background_images[phrase_index % background_images.size()];
+        return base.substr(0, base.size() - 4) + suffix; // personajes/1000.png -> personajes/1000_Listening.png
+    };
     const string english_images_path = "imagenes_generadas/Imagenes_English"; // Subcarpeta dentro de imagenes_generadas
     const string spanish_images_path = "imagenes_generadas/Imagenes_Spanish"; // Subcarpeta dentro de imagenes_generadas
     const string audio_preparation_output_dir = "Audios_Main_Lesson_Prepared"; // Directorio temporal para audios de Main Lesson
     const string silence_for_preparation_file = "silence_prep.mp3"; // Archivo de silencio temporal
 
-    // --- 1. Generar "Fondo Sin Subtitulos" ---
-    std::cout << "\n--- Generando Fondo Sin Subtitulos.mp4 ---\n";
-    silence_duration = 1.0f;
-    video_name = "Fondo_Sin_Subtitulos.mp4";
-    images_to_process.clear();
-    audios_to_process.clear();
-
-    for (int i = 0; i < indices.total_phrases; ++i) {
-        if (i % 2 == 0) { 
-            images_to_process.push_back(personajes_path + "/1000_Listening.png");
-        } else {
-            images_to_process.push_back(personajes_path + "/2000_Listening.png");
+    // Con --solo-main se omiten los cuatro videos de repaso.
+    if (!solo_main) {
+        // --- 1. Generar "Fondo Sin Subtitulos" ---
+        std::cout << "\n--- Generando Fondo Sin Subtitulos.mp4 ---\n";
+        silence_duration = 1.0f;
+        video_name = "Fondo_Sin_Subtitulos.mp4";
+        images_to_process.clear();
+        audios_to_process.clear();
+
+        for (int i = 0; i < indices.total_phrases && !background_images.empty(); ++i) {
+            images_to_process.push_back(background_variant(i, "_Listening" + frame_extension));
         }
-    }
     
-    // Asegura que el número de imágenes coincida con el número de audios de diálogo disponibles
-    if (images_to_process.size() > all_dialogue_audios.size()) {
-        std::cerr << "Advertencia: No hay suficientes archivos de audio de dialogo para todas las imagenes de Fondo Sin Subtitulos. Se usaran los audios disponibles." << std::endl;
-        images_to_process.resize(all_dialogue_audios.size()); 
-    }
-    for(size_t i = 0; i < images_to_process.size(); ++i) {
-        audios_to_process.push_back(all_dialogue_audios[i]);
-    }
-    if (audios_to_process.empty() || images_to_process.empty()) { 
-        std::cerr << "Error: No hay audios o imagenes para la opcion Fondo Sin Subtitulos. No se generara este video." << std::endl;
-    } else {
-        generate_final_video_from_lists(silence_duration, video_name, audios_to_process, images_to_process, current_project_video_output_dir);
-    }
-
-    // --- 2. Generar "Fondo con Test" ---
-    std::cout << "\n--- Generando Fondo con Test.mp4 ---\n";
-    silence_duration = 1.0f;
-    video_name = "Fondo_con_Test.mp4";
-    images_to_process.clear();
-    audios_to_process.clear();
-
-    for (int i = 0; i < indices.total_phrases; ++i) {
-        if (i % 2 == 0) { 
-            images_to_process.push_back(personajes_path + "/1000_Test.png");
+        // Asegura que el número de imágenes coincida con el número de audios de diálogo disponibles
+        if (images_to_process.size() > all_dialogue_audios.size()) {
+            std::cerr << "Advertencia: No hay suficientes archivos de audio de dialogo para todas las imagenes de Fondo Sin Subtitulos. Se usaran los audios disponibles." << std::endl;
+            images_to_process.resize(all_dialogue_audios.size()); 
+        }
+        for(size_t i = 0; i < images_to_process.size(); ++i) {
+            audios_to_process.push_back(all_dialogue_audios[i]);
+        }
+        if (audios_to_process.empty() || images_to_process.empty()) { 
+            std::cerr << "Error: No hay audios o imagenes para la opcion Fondo Sin Subtitulos. No se generara este video." << std::endl;
         } else {
-            images_to_process.push_back(personajes_path + "/2000_Test.png");
+            generate_final_video_from_lists(silence_duration, video_name, audios_to_process, images_to_process, current_project_video_output_dir);
         }
-    }
-    
-    if (images_to_process.size() > all_dialogue_audios.size()) {
-        std::cerr << "Advertencia: No hay suficientes archivos de audio de dialogo para todas las imagenes de Fondo con Test. Se usaran los audios disponibles." << std::endl;
-        images_to_process.resize(all_dialogue_audios.size()); 
-    }
-    for(size_t i = 0; i < images_to_process.size(); ++i) {
-        audios_to_process.push_back(all_dialogue_audios[i]);
-    }
-    if (audios_to_process.empty() || images_to_process.empty()) { 
-        std::cerr << "Error: No hay audios o imagenes para la opcion Fondo con Test. No se generara este video." << std::endl;
-    } else {
-        generate_final_video_from_lists(silence_duration, video_name, audios_to_process, images_to_process, current_project_video_output_dir);
-    }
 
-    // --- 3. Generar "Fondo con subtitulos en ingles" ---
-    std::cout << "\n--- Generando Fondo_Subtitulos_English.mp4 ---\n";
-    silence_duration = 1.0f;
-    video_name = "Fondo_Subtitulos_English.mp4";
-    images_to_process.clear();
-    audios_to_process.clear();
+        // --- 2. Generar "Fondo con Test" ---
+        std::cout << "\n--- Generando Fondo con Test.mp4 ---\n";
+        silence_duration = 1.0f;
+        video_name = "Fondo_con_Test.mp4";
+        images_to_process.clear();
+        audios_to_process.clear();
 
-    for (int img_idx : indices.english_only_images) {
-        images_to_process.push_back("imagenes_generadas/" + std::to_string(img_idx) + ".png"); // Las imágenes están en imagenes_generadas
-    }
+        for (int i = 0; i < indices.total_phrases && !background_images.empty(); ++i) {
+            images_to_process.push_back(background_variant(i, "_Test" + frame_extension));
+        }
     
-    if (images_to_process.size() > all_dialogue_audios.size()) {
-        std::cerr << "Advertencia: No hay suficientes archivos de audio de dialogo para todas las imagenes de Fondo con subtitulos en ingles. Se usaran los audios disponibles." << std::endl;
-        images_to_process.resize(all_dialogue_audios.size()); 
-    }
-    for(size_t i = 0; i < images_to_process.size(); ++i) {
-        audios_to_process.push_back(all_dialogue_audios[i]);
-    }
-    if (audios_to_process.empty() || images_to_process.empty()) { 
-        std::cerr << "Error: No hay audios o imagenes para la opcion Fondo con subtitulos en ingles. No se generara este video." << std::endl;
-    } else {
-        generate_final_video_from_lists(silence_duration, video_name, audios_to_process, images_to_process, current_project_video_output_dir);
-    }
+        if (images_to_process.size() > all_dialogue_audios.size()) {
+            std::cerr << "Advertencia: No hay suficientes archivos de audio de dialogo para todas las imagenes de Fondo con Test. Se usaran los audios disponibles." << std::endl;
+            images_to_process.resize(all_dialogue_audios.size()); 
+        }
+        for(size_t i = 0; i < images_to_process.size(); ++i) {
+            audios_to_process.push_back(all_dialogue_audios[i]);
+        }
+        if (audios_to_process.empty() || images_to_process.empty()) { 
+            std::cerr << "Error: No hay audios o imagenes para la opcion Fondo con Test. No se generara este video." << std::endl;
+        } else {
+            generate_final_video_from_lists(silence_duration, video_name, audios_to_process, images_to_process, current_project_video_output_dir);
+        }
 
-    // --- 4. Generar "Fondo con subtitulos en ingles y espanol" ---
-    std::cout << "\n--- Generando Fondo_Subtitulos_English_Spanish.mp4 ---\n";
-    silence_duration = 1.0f;
-    video_name = "Fondo_Subtitulos_English_Spanish.mp4";
-    images_to_process.clear();
-    audios_to_process.clear();
+        // --- 3. Generar "Fondo con subtitulos en ingles" ---
+        std::cout << "\n--- Generando Fondo_Subtitulos_English.mp4 ---\n";
+        silence_duration = 1.0f;
+        video_name = "Fondo_Subtitulos_English.mp4";
+        images_to_process.clear();
+        rendered_frames.backgrounds.clear();
+        rendered_frames.numbers.clear();
+        audios_to_process.clear();
+
+        for (int img_idx : indices.english_only_images) {
+            images_to_process.push_back(frame_path(frame_manifest, "imagenes_generadas", img_idx)); // Las imágenes están en imagenes_generadas
+            rendered_frames.backgrounds.push_back(frame_background(frame_manifest, img_idx));
+            rendered_frames.numbers.push_back(img_idx);
+        }
+    
+        if (images_to_process.size() > all_dialogue_audios.size()) {
+            std::cerr << "Advertencia: No hay suficientes archivos de audio de dialogo para todas las imagenes de Fondo con subtitulos en ingles. Se usaran los audios disponibles." << std::endl;
+            images_to_process.resize(all_dialogue_audios.size()); 
+        }
+        for(size_t i = 0; i < images_to_process.size(); ++i) {
+            audios_to_process.push_back(all_dialogue_audios[i]);
+        }
+        if (audios_to_process.empty() || images_to_process.empty()) { 
+            std::cerr << "Error: No hay audios o imagenes para la opcion Fondo con subtitulos en ingles. No se generara este video." << std::endl;
+        } else {
+            generate_final_video_from_lists(silence_duration, video_name, audios_to_process, images_to_process, current_project_video_output_dir, "", rendered_frames);
+        }
 
-    for (int img_idx : indices.english_spanish_images) {
-        images_to_process.push_back("imagenes_generadas/" + std::to_string(img_idx) + ".png"); // Las imágenes están en imagenes_generadas
-    }
+        // --- 4. Generar "Fondo con subtitulos en ingles y espanol" ---
+        std::cout << "\n--- Generando Fondo_Subtitulos_English_Spanish.mp4 ---\n";
+        silence_duration = 1.0f;
+        video_name = "Fondo_Subtitulos_English_Spanish.mp4";
+        images_to_process.clear();
+        rendered_frames.backgrounds.clear();
+        rendered_frames.numbers.clear();
+        audios_to_process.clear();
+
+        for (int img_idx : indices.english_spanish_images) {
+            images_to_process.push_back(frame_path(frame_manifest, "imagenes_generadas", img_idx)); // Las imágenes están en imagenes_generadas
+            rendered_frames.backgrounds.push_back(frame_background(frame_manifest, img_idx));
+            rendered_frames.numbers.push_back(img_idx);
+        }
     
-    if (images_to_process.size() > all_dialogue_audios.size()) {
-        std::cerr << "Advertencia: No hay suficientes archivos de audio de dialogo para todas las imagenes de Fondo con subtitulos en ingles y espanol. Se usaran los audios disponibles." << std::endl;
-        images_to_process.resize(all_dialogue_audios.size()); 
-    }
-    for(size_t i = 0; i < images_to_process.size(); ++i) {
-        audios_to_process.push_back(all_dialogue_audios[i]);
-    }
-    if (audios_to_process.empty() || images_to_process.empty()) { 
-        std::cerr << "Error: No hay audios o imagenes para la opcion Fondo con subtitulos en ingles y espanol. No se generara este video." << std::endl;
-    } else {
-        generate_final_video_from_lists(silence_duration, video_name, audios_to_process, images_to_process, current_project_video_output_dir);
+        if (images_to_process.size() > all_dialogue_audios.size()) {
+            std::cerr << "Advertencia: No hay suficientes archivos de audio de dialogo para todas las imagenes de Fondo con subtitulos en ingles y espanol. Se usaran los audios disponibles." << std::endl;
+            images_to_process.resize(all_dialogue_audios.size()); 
+        }
+        for(size_t i = 0; i < images_to_process.size(); ++i) {
+            audios_to_process.push_back(all_dialogue_audios[i]);
+        }
+        if (audios_to_process.empty() || images_to_process.empty()) { 
+            std::cerr << "Error: No hay audios o imagenes para la opcion Fondo con subtitulos en ingles y espanol. No se generara este video." << std::endl;
+        } else {
+            generate_final_video_from_lists(silence_duration, video_name, audios_to_process, images_to_process, current_project_video_output_dir, "", rendered_frames);
+        }
     }
 
     // --- 5. Generar "Main_Lesson.mp4" ---
@@ -546,8 +809,12 @@ int main(int argc, char* argv[]) {
         
         // Las imágenes para Main Lesson se obtienen de imagenes_generadas/
         images_to_process.clear(); // Limpiar antes de llenar
+        rendered_frames.backgrounds.clear();
+        rendered_frames.numbers.clear();
         for (int i = 1; i <= indices.total_generated_images; ++i) {
-            images_to_process.push_back("imagenes_generadas/" + std::to_string(i) + ".png");
+            images_to_process.push_back(frame_path(frame_manifest, "imagenes_generadas", i));
+            rendered_frames.backgrounds.push_back(frame_background(frame_manifest, i));
+            rendered_frames.numbers.push_back(i);
         }
         
         // Verifica si hay suficientes imágenes para los audios preparados
@@ -565,10 +832,12 @@ int main(int argc, char* argv[]) {
         if (audios_to_process.empty() || images_to_process.empty()) { 
             std::cerr << "Error: No hay audios o imagenes para la opcion Main Lesson. No se generara este video." << std::endl;
         } else {
-            generate_final_video_from_lists(silence_duration, video_name, audios_to_process, images_to_process, current_project_video_output_dir, audio_preparation_output_dir);
+            generate_final_video_from_lists(silence_duration, video_name, audios_to_process, images_to_process, current_project_video_output_dir, audio_preparation_output_dir, rendered_frames);
         }
     }
 
+    run_pending_stream_jobs();
+
     std::cout << "\nFinalizado el procesamiento de videos para el proyecto: '" << video_project_folder_name << "'." << std::endl;
     // No esperar tecla aquí, ya que será llamado por otro exe
     // system("pause"); 
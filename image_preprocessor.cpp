@@ -11,7 +11,19 @@
 #include <cstdlib>     // For system()
 #include <algorithm>   // For std::min and std::max
 #include <cctype>      // For isspace
+#include <cmath>       // Para el contorno del texto
 #include <filesystem>  // For std::filesystem (requires C++17)
+#include <map>         // For the frame manifest
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <functional>  // Para los rotulos
+#include <iomanip>     // Para los nombres de los sprites
+#include <stdexcept>   // Errores de los trabajos de run_parallel
+#include "frame_io.hpp" // Formatos, escritor asincrono, pool de buffers, mezcla de color y fondos (compartido con imagenes.cpp)
 
 using namespace cv;
 using namespace std;
@@ -30,56 +42,19 @@ const string FONT_PATH = "Montserrat-Bold.ttf";
 const int BASE_IMG_WIDTH = 1920; 
 const int BASE_IMG_HEIGHT = 1080; 
 
-// Colores
-const Scalar COLOR_RECTANGULO_CELESTE_AZULADO = Scalar(255, 175, 80); // BGR: B=255, G=175, R=80
-const Scalar COLOR_RECTANGULO_VERDE_CLARO = Scalar(120, 255, 120); // BGR: B=120, G=255, R=120
-const Scalar COLOR_TEXTO_BLANCO = Scalar(255, 255, 255); 
-const Scalar COLOR_TEXTO_OUTLINE_NEGRO = Scalar(0, 0, 0); 
-
-// Opacidades
-const double RECTANGLE_OPACITY_LISTENING_SUBTITLES = 0.75; 
-const double RECTANGLE_OPACITY_TEST = 0.70; 
-
-// Márgenes y Espaciados
-const int MARGIN_TOP_DEFAULT = 30;    // Para rectángulos en la parte superior
-const int MARGIN_BOTTOM_DEFAULT = 30; // Para rectángulos en la parte inferior
-const int MARGIN_SIDES_DEFAULT = 30;  // Para ambos lados
-
-const int SPACING_BETWEEN_TEST_RECTS = 20; // Espacio entre los dos rectángulos de "Test"
-
-// Paddings (relleno del texto dentro del rectángulo)
-const int PADDING_VERTICAL_LISTENING = 30;   // Para "Escucha sin Subtítulos"
-const int PADDING_HORIZONTAL_LISTENING = 50; 
-
-const int PADDING_VERTICAL_SUBTITLES = 30;   // Para "Escucha con subtítulos..."
-const int PADDING_HORIZONTAL_SUBTITLES = 50;
-
-const int PADDING_VERTICAL_TEST_BLUE = 30;   // Para rect azul de "Test"
-const int PADDING_HORIZONTAL_TEST_BLUE = 50;
-
-const int PADDING_VERTICAL_TEST_GREEN = 15;  // Para rect verde de "Test"
-const int PADDING_HORIZONTAL_TEST_GREEN = 25;
-
-// Tamaños de Fuente
-const int FONT_HEIGHT_LISTENING = 120;       // "Escucha sin Subtítulos"
-const int FONT_HEIGHT_SUBTITLES_EN_ES = 75;  // "Escucha con subtítulos en Inglés y Español"
-const int FONT_HEIGHT_SUBTITLES_EN = 80;     // "Escucha con subtítulos en Inglés"
-const int FONT_HEIGHT_TEST_BLUE = 100;       // "¿Sientes que has mejorado?"
-const int FONT_HEIGHT_TEST_GREEN = 70;       // "Cuéntamelo en los comentarios"
-
-// Grosor del contorno (outline) del texto
-const int OUTLINE_THICKNESS = 4; 
+// Los colores, margenes, paddings, tamanos de fuente y textos de los rotulos estan en frame_io.hpp,
+// compartidos con los rotulos que imagenes dibuja con --rotulos.
 
 // --- FIN CONSTANTES GLOBALES ---
 
 
-// Function to read and parse IndicesImagenes.txt
-IndicesData read_indices_file(const std::string& filename) {
-    IndicesData data;
+// Function to read and parse IndicesImagenes.txt. Returns false (after printing the error) if
+// the file is missing or malformed.
+bool read_indices_file(const std::string& filename, IndicesData& data) {
     std::ifstream file(filename);
     if (!file.is_open()) {
         std::cerr << "Error: No se pudo abrir el archivo " << filename << std::endl;
-        exit(EXIT_FAILURE);
+        return false;
     }
 
     std::string line;
@@ -96,7 +71,7 @@ IndicesData read_indices_file(const std::string& filename) {
                     data.english_only_images.push_back(std::stoi(segment));
                 } catch (const std::invalid_argument& e) {
                     std::cerr << "Error: Formato invalido en la linea 1 de " << filename << ". Esperaba numeros." << std::endl;
-                    exit(EXIT_FAILURE);
+                    return false;
                 }
             }
         } else if (line_num == 2) { // English and Spanish images
@@ -105,7 +80,7 @@ IndicesData read_indices_file(const std::string& filename) {
                     data.english_spanish_images.push_back(std::stoi(segment));
                 } catch (const std::invalid_argument& e) {
                     std::cerr << "Error: Formato invalido en la linea 2 de " << filename << ". Esperaba numeros." << std::endl;
-                    exit(EXIT_FAILURE);
+                    return false;
                 }
             }
         } else if (line_num == 3) { // Total phrases
@@ -113,26 +88,108 @@ IndicesData read_indices_file(const std::string& filename) {
                 data.total_phrases = std::stoi(line);
             } catch (const std::invalid_argument& e) {
                 std::cerr << "Error: Formato invalido en la linea 3 de " << filename << ". Esperaba un numero entero." << std::endl;
-                exit(EXIT_FAILURE);
+                return false;
             }
         } else if (line_num == 4) { // Total generated images
             try {
                 data.total_generated_images = std::stoi(line);
             } catch (const std::invalid_argument& e) {
                 std::cerr << "Error: Formato invalido en la linea 4 de " << filename << ". Esperaba un numero entero." << std::endl;
-                exit(EXIT_FAILURE);
+                return false;
             }
         }
     }
 
     if (line_num < 4) {
         std::cerr << "Error: El archivo " << filename << " no tiene el formato esperado (menos de 4 lineas)." << std::endl;
-        exit(EXIT_FAILURE);
+        return false;
+    }
+
+    return true;
+}
+
+
+// Manifiesto de frames de imagenes.cpp: cada linea es numero_frame|archivo|hash, y en modo
+// teselas (cabecera "#teselas|fila") lleva ademas |fondo: el archivo es entonces una tesela
+// RGBA que se superpone al fondo a partir de la fila indicada.
+struct FrameManifest {
+    std::map<int, std::string> files;        // numero de frame -> ruta del archivo
+    std::map<int, std::string> backgrounds;  // numero de frame -> ruta del fondo (modo teselas)
+    int tile_y = -1;                         // -1 = frames completos
+};
+
+FrameManifest read_frame_manifest(const std::string& frames_dir) {
+    FrameManifest manifest;
+    std::ifstream file(frames_dir + "/manifiesto_frames.txt");
+    if (!file.is_open()) {
+        return manifest; // Sin manifiesto: se usa la convencion antigua {indice}.png
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::stringstream ss(line);
+        std::string frame_number, file_name, hash, background;
+        if (!std::getline(ss, frame_number, '|') || !std::getline(ss, file_name, '|')) continue;
+        try {
+            if (frame_number == "#teselas") {
+                manifest.tile_y = std::stoi(file_name);
+                continue;
+            }
+            if (frame_number == "#rotulos") continue; // imagenes.exe --rotulos; ver --solo-fondos
+            int number = std::stoi(frame_number);
+            manifest.files[number] = frames_dir + "/" + file_name;
+            if (std::getline(ss, hash, '|') && std::getline(ss, background, '|') && !background.empty()) {
+                manifest.backgrounds[number] = frames_dir + "/" + background;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Advertencia: Linea invalida en el manifiesto de frames: " << line << std::endl;
+        }
+    }
+    return manifest;
+}
+
+// Devuelve la ruta del archivo de un frame segun el manifiesto, o {indice}.png si no aparece en el.
+std::string frame_path(const FrameManifest& manifest, const std::string& frames_dir, int frame_number) {
+    auto it = manifest.files.find(frame_number);
+    if (it != manifest.files.end()) return it->second;
+    return frames_dir + "/" + std::to_string(frame_number) + ".png";
+}
+
+// Carga el frame completo numero frame_number. En modo teselas compone la tesela RGBA sobre
+// su fondo a partir de la fila tile_y, igual que el filtro overlay de generar_videos.
+Mat load_frame(const FrameManifest& manifest, const std::string& frames_dir, int frame_number) {
+    Mat frame = readFrameImage(frame_path(manifest, frames_dir, frame_number));
+    auto background = manifest.backgrounds.find(frame_number);
+    if (frame.empty() || manifest.tile_y < 0 || background == manifest.backgrounds.end()) {
+        if (!frame.empty() && frame.channels() == 4) cvtColor(frame, frame, COLOR_BGRA2BGR);
+        return frame;
     }
 
-    return data;
+    Mat composed = readFrameImage(background->second);
+    if (composed.empty() || frame.channels() != 4 || composed.channels() != 3 ||
+        frame.cols != composed.cols || manifest.tile_y + frame.rows > composed.rows) {
+        return Mat();
+    }
+    for (int y = 0; y < frame.rows; ++y) {
+        const uchar* src = frame.ptr<uchar>(y);
+        uchar* dst = composed.ptr<uchar>(manifest.tile_y + y);
+        for (int x = 0; x < frame.cols; ++x, src += 4, dst += 3) {
+            int a = src[3];
+            if (a == 0) continue;
+            for (int c = 0; c < 3; ++c) {
+                dst[c] = static_cast<uchar>((src[c] * a + dst[c] * (255 - a) + 127) / 255);
+            }
+        }
+    }
+    return composed;
 }
 
+// Copia una imagen en un buffer del pool.
+Mat pooled_copy(const Mat& source) {
+    Mat copy = framePool.acquire(source.rows, source.cols, source.type());
+    source.copyTo(copy);
+    return copy;
+}
 
 // Función para eliminar espacios en blanco al principio y al final de una cadena
 string trim(const string& str) {
@@ -144,120 +201,160 @@ string trim(const string& str) {
     return str.substr(first, (last - first + 1));
 }
 
-// Envuelve el texto en múltiples líneas para ajustarse al ancho máximo.
-vector<string> wrapText(Ptr<freetype::FreeType2> ft2, const string& text, int fontHeight, int maxWidth) {
-    vector<string> lines;
-    stringstream ss(text);
-    string word;
-    string currentLine;
-    bool firstWordInLine = true;
-
-    while (ss >> word) {
-        string testLine = currentLine;
-        if (!firstWordInLine) {
-            testLine += " ";
+// Registro de fuentes del proceso: cada archivo .ttf se lee del disco una sola vez y cada hilo
+// construye su propia cara de FreeType a partir de esos bytes la primera vez que la pide
+// (FreeType2 no se puede compartir entre hilos). OpenCV recibe la altura en cada llamada, asi
+// que una cara sirve para todos los tamanos. Antes cada imagen creaba y cargaba la suya.
+class FontRegistry {
+public:
+    // Fuente lista para usar en el hilo actual. Lanza std::runtime_error si no se puede cargar.
+    Ptr<freetype::FreeType2> get(const std::string& path) {
+        thread_local std::map<std::string, Ptr<freetype::FreeType2>> faces;
+        Ptr<freetype::FreeType2>& face = faces[path];
+        if (face) return face;
+
+        face = freetype::createFreeType2();
+        try {
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 8)
+            // FreeType lee de este buffer mientras exista la cara, por eso el registro lo conserva
+            std::vector<char>& data = font_bytes(path);
+            face->loadFontData(data.data(), data.size(), 0);
+#else
+            face->loadFontData(path, 0); // Versiones sin carga desde memoria: se lee el archivo por hilo
+#endif
+        } catch (const cv::Exception& e) {
+            face.reset(); // El siguiente intento de este hilo vuelve a cargarla
+            throw std::runtime_error("No se pudo cargar la fuente '" + path + "'. Asegurese de que este en el mismo directorio que el ejecutable.\nError de OpenCV FreeType: " + e.what());
         }
-        testLine += word;
-
-        Size textSize = ft2->getTextSize(testLine, fontHeight, -1, nullptr);
+        return face;
+    }
 
-        if (textSize.width <= maxWidth) {
-            currentLine = testLine;
-        } else {
-            if (!currentLine.empty()) {
-                lines.push_back(currentLine);
+private:
+    // Contenido del archivo, leido la primera vez que se pide.
+    std::vector<char>& font_bytes(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::unique_ptr<std::vector<char>>& data = files[path];
+        if (!data) {
+            std::ifstream file(path, std::ios::binary);
+            if (!file.is_open()) {
+                files.erase(path);
+                throw std::runtime_error("No se pudo abrir la fuente '" + path + "'. Asegurese de que este en el mismo directorio que el ejecutable.");
             }
-            currentLine = word;
-            firstWordInLine = true; 
+            data = std::make_unique<std::vector<char>>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
         }
-        firstWordInLine = false;
-    }
-    if (!currentLine.empty()) {
-        lines.push_back(currentLine);
+        return *data;
     }
-    return lines;
+
+    std::mutex mtx;
+    std::map<std::string, std::unique_ptr<std::vector<char>>> files;
+};
+
+FontRegistry font_registry;
+
+// --- ROTULOS FIJOS COMO SPRITES ---
+// Los rotulos (panel semitransparente con texto contorneado) no cambian entre imagenes: cada
+// uno se dibuja una vez en un sprite BGRA premultiplicado de BASE_IMG_WIDTH x BASE_IMG_HEIGHT
+// y cada imagen de salida es una sola composicion del sprite sobre su fondo. Los sprites se
+// guardan en LABEL_SPRITE_DIR con un nombre derivado del texto, las constantes de estilo y la
+// fuente, asi que las ejecuciones siguientes ni siquiera cargan FreeType.
+const std::string LABEL_SPRITE_DIR = "cache_rotulos";
+const int LABEL_SPRITE_VERSION = 2; // Cambiar si cambia la forma de dibujar los rotulos
+
+void append_key(std::ostringstream& key, const Scalar& color) {
+    key << color[0] << ',' << color[1] << ',' << color[2] << '|';
 }
 
-// Calcula la altura total del texto envuelto.
-int calculateWrappedTextHeight(Ptr<freetype::FreeType2> ft2, const string& text, int fontHeight, int maxWidth) {
-    vector<string> lines = wrapText(ft2, text, fontHeight, maxWidth);
-    if (lines.empty()) return 0;
-    
-    int singleLineRenderHeight = ft2->getTextSize("Tg", fontHeight, -1, nullptr).height;
-    
-    int totalTextHeight = lines.size() * singleLineRenderHeight;
-    return totalTextHeight;
+template <typename T>
+void append_key(std::ostringstream& key, const T& value) {
+    key << value << '|';
 }
 
-// Dibuja texto envuelto, centrado vertical y horizontalmente dentro de un Rect con un contorno.
-void drawWrappedTextWithOutline(
-    Mat& img,
-    Ptr<freetype::FreeType2> ft2,
-    const string& text,
-    const Rect& rect,
-    int fontHeight,
-    Scalar textColor,
-    Scalar outlineColor,
-    int outlineThickness,
-    int horizontalPadding, 
-    int verticalPadding)   
-{ 
-    int text_area_width = rect.width - (2 * horizontalPadding);
-    vector<string> lines = wrapText(ft2, text, fontHeight, text_area_width);
-
-    if (lines.empty()) return;
-
-    int singleLineRenderHeight = ft2->getTextSize("Tg", fontHeight, -1, nullptr).height;
-    int totalRenderedTextHeight = lines.size() * singleLineRenderHeight;
-
-    int current_line_y_start = rect.y + verticalPadding + ( (rect.height - (2 * verticalPadding) - totalRenderedTextHeight) / 2 );
-    
-    for (const string& line : lines) {
-        Size lineSize = ft2->getTextSize(line, fontHeight, -1, nullptr);
-        int line_x_initial = rect.x + horizontalPadding + (text_area_width - lineSize.width) / 2;
-        int baseline_y_initial = current_line_y_start + singleLineRenderHeight;
-        
-        for (int i = -outlineThickness; i <= outlineThickness; ++i) {
-            for (int j = -outlineThickness; j <= outlineThickness; ++j) {
-                if (i == 0 && j == 0) continue; 
-                ft2->putText(img, line, Point(line_x_initial + j, baseline_y_initial + i), fontHeight, outlineColor, -1, LINE_AA, true);
+// Clave de un rotulo: todos los valores que determinan su aspecto, separados por '|'.
+template <typename... Values>
+std::string label_key(const Values&... values) {
+    std::ostringstream key;
+    (append_key(key, values), ...);
+    return key.str();
+}
+
+// Sprites de los rotulos del proceso, cargados del disco o dibujados la primera vez que se piden.
+// Seguro entre hilos: cada sprite lo prepara el primer hilo que lo pide mientras los demas esperan.
+class LabelSpriteCache {
+public:
+    // draw dibuja el rotulo sobre una imagen de BASE_IMG_WIDTH x BASE_IMG_HEIGHT; solo se llama
+    // si el sprite de `key` no esta en memoria ni en disco.
+    const LabelSprite& get(const std::string& key, const std::function<void(Mat&)>& draw) {
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            std::shared_ptr<Entry>& slot = entries[key];
+            if (!slot) slot = std::make_shared<Entry>();
+            entry = slot;
+        }
+        std::call_once(entry->built, [&]() { entry->sprite = load_or_draw(key, draw); });
+        return entry->sprite;
+    }
+
+private:
+    struct Entry {
+        std::once_flag built;
+        LabelSprite sprite;
+    };
+
+    static LabelSprite load_or_draw(const std::string& key, const std::function<void(Mat&)>& draw) {
+        const Size size(BASE_IMG_WIDTH, BASE_IMG_HEIGHT);
+        const std::string path = LABEL_SPRITE_DIR + "/" + sprite_name(key) + ".png";
+        Mat bgra = imread(path, IMREAD_UNCHANGED);
+        if (bgra.type() != CV_8UC4 || bgra.size() != size) {
+            bgra = renderLabelBgra(size, draw);
+            std::error_code ec;
+            fs::create_directories(LABEL_SPRITE_DIR, ec);
+            if (!imwrite(path, bgra)) {
+                cerr << "Advertencia: No se pudo guardar el rotulo en '" << path << "'; se dibujara de nuevo en la proxima ejecucion." << endl;
             }
         }
-        ft2->putText(img, line, Point(line_x_initial, baseline_y_initial), fontHeight, textColor, -1, LINE_AA, true);
 
-        current_line_y_start += singleLineRenderHeight;
+        return cropLabelSprite(bgra);
     }
-}
 
-// Function to generate the "Listening" image (Fondo Sin Subtitulos style)
-void generate_listening_image(const std::string& base_image_path, const std::string& output_filepath) {
-    Mat backgroundImage = imread(base_image_path);
-    if (backgroundImage.empty()) {
-        cerr << "Error: No se pudo cargar la imagen base desde '" << base_image_path << "' para Listening Image." << endl;
-        exit(EXIT_FAILURE);
+    // FNV-1a de la clave junto con lo que afecta a todos los rotulos: fuente, contorno,
+    // tamano de imagen y version del dibujo.
+    static std::string sprite_name(const std::string& key) {
+        std::error_code ec;
+        const auto font_size = fs::file_size(FONT_PATH, ec);
+        const auto font_time = fs::last_write_time(FONT_PATH, ec).time_since_epoch().count();
+        const std::string full_key = label_key(key, FONT_PATH, font_size, font_time, OUTLINE_THICKNESS,
+                                               BASE_IMG_WIDTH, BASE_IMG_HEIGHT, LABEL_SPRITE_VERSION);
+        uint64_t hash = 1469598103934665603ULL;
+        for (unsigned char c : full_key) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        std::ostringstream name;
+        name << std::hex << std::setw(16) << std::setfill('0') << hash;
+        return name.str();
     }
-    resize(backgroundImage, backgroundImage, Size(BASE_IMG_WIDTH, BASE_IMG_HEIGHT), 0, 0, INTER_LINEAR);
 
-    Ptr<freetype::FreeType2> ft2 = freetype::createFreeType2();
-    try {
-        ft2->loadFontData(FONT_PATH, 0);
-    } catch (const cv::Exception& e) {
-        cerr << "Error: No se pudo cargar la fuente '" << FONT_PATH << "'. Asegurese de que este en el mismo directorio que el ejecutable." << endl;
-        cerr << "Error de OpenCV FreeType: " << e.what() << endl;
-        exit(EXIT_FAILURE);
-    }
-    
-    string text_to_display = "Escucha sin Subtítulos";
+    std::mutex mtx;
+    std::map<std::string, std::shared_ptr<Entry>> entries;
+};
+
+LabelSpriteCache label_sprites;
+
+// Rotulo "Escucha sin Subtitulos" en la parte inferior.
+void draw_listening_label(Mat& outputImage) {
+    Ptr<freetype::FreeType2> ft2 = font_registry.get(FONT_PATH);
+    const string& text_to_display = TEXTO_LISTENING;
 
     int max_text_width_for_wrap = BASE_IMG_WIDTH - (2 * MARGIN_SIDES_DEFAULT) - (2 * PADDING_HORIZONTAL_LISTENING);
-    vector<string> wrapped_lines = wrapText(ft2, text_to_display, FONT_HEIGHT_LISTENING, max_text_width_for_wrap);
+    vector<string> wrapped_lines = wrapLabelText(ft2, text_to_display, FONT_HEIGHT_LISTENING, max_text_width_for_wrap);
     
     int actual_wrapped_text_width = 0;
     for (const string& line : wrapped_lines) {
         actual_wrapped_text_width = max(actual_wrapped_text_width, ft2->getTextSize(line, FONT_HEIGHT_LISTENING, -1, nullptr).width);
     }
 
-    int text_height_in_lines = calculateWrappedTextHeight(ft2, text_to_display, FONT_HEIGHT_LISTENING, max_text_width_for_wrap);
+    int text_height_in_lines = labelTextHeight(ft2, text_to_display, FONT_HEIGHT_LISTENING, max_text_width_for_wrap);
     
     int rect_width = actual_wrapped_text_width + (2 * PADDING_HORIZONTAL_LISTENING);
     int rect_height = text_height_in_lines + (2 * PADDING_VERTICAL_LISTENING);
@@ -269,51 +366,48 @@ void generate_listening_image(const std::string& base_image_path, const std::str
 
     Rect mainRect(rect_x, rect_y, rect_width, rect_height);
 
-    Mat outputImage = backgroundImage.clone();
-
     // Aplicar el rectángulo semi-transparente
     Mat roi = outputImage(mainRect);
-    Mat coloredOverlay(roi.size(), outputImage.type(), COLOR_RECTANGULO_CELESTE_AZULADO); 
-    addWeighted(coloredOverlay, RECTANGLE_OPACITY_LISTENING_SUBTITLES, roi, 1.0 - RECTANGLE_OPACITY_LISTENING_SUBTITLES, 0.0, roi);
+    blendConstantColor(roi, COLOR_RECTANGULO_CELESTE_AZULADO, RECTANGLE_OPACITY_LISTENING_SUBTITLES);
 
     // Dibujar el texto sobre el rectángulo con contorno
     drawWrappedTextWithOutline(outputImage, ft2, text_to_display, mainRect, FONT_HEIGHT_LISTENING, COLOR_TEXTO_BLANCO, COLOR_TEXTO_OUTLINE_NEGRO, OUTLINE_THICKNESS, PADDING_HORIZONTAL_LISTENING, PADDING_VERTICAL_LISTENING);
-
-    imwrite(output_filepath, outputImage);
-    cout << "✅ Imagen generada: " << output_filepath << endl;
 }
 
-// Function to generate the "Test" image (Fondo con Test style)
-void generate_test_image(const std::string& base_image_path, const std::string& output_filepath) {
-    Mat backgroundImage = imread(base_image_path);
+// Function to generate the "Listening" image (Fondo Sin Subtitulos style)
+void generate_listening_image(BackgroundCache& backgrounds, AsyncFrameWriter& writer, const std::string& base_image_path, const std::string& output_filepath) {
+    const Mat& backgroundImage = backgrounds.get(base_image_path, Size(BASE_IMG_WIDTH, BASE_IMG_HEIGHT));
     if (backgroundImage.empty()) {
-        cerr << "Error: No se pudo cargar la imagen base desde '" << base_image_path << "' para Test Image." << endl;
-        exit(EXIT_FAILURE);
+        throw std::runtime_error("No se pudo cargar la imagen base desde '" + base_image_path + "' para Listening Image.");
     }
-    resize(backgroundImage, backgroundImage, Size(BASE_IMG_WIDTH, BASE_IMG_HEIGHT), 0, 0, INTER_LINEAR);
 
-    Ptr<freetype::FreeType2> ft2 = freetype::createFreeType2();
-    try {
-        ft2->loadFontData(FONT_PATH, 0);
-    } catch (const cv::Exception& e) {
-        cerr << "Error: No se pudo cargar la fuente '" << FONT_PATH << "'. Asegurese de que este en el mismo directorio que el ejecutable." << endl;
-        cerr << "Error de OpenCV FreeType: " << e.what() << endl;
-        exit(EXIT_FAILURE);
-    }
-    
-    string text_blue_rect = "¿Sientes que has mejorado?";
-    string text_green_rect = "Cuéntamelo en los comentarios";
+    const LabelSprite& label = label_sprites.get(
+        label_key("listening", TEXTO_LISTENING, FONT_HEIGHT_LISTENING, PADDING_HORIZONTAL_LISTENING, PADDING_VERTICAL_LISTENING,
+                  MARGIN_SIDES_DEFAULT, MARGIN_BOTTOM_DEFAULT, COLOR_RECTANGULO_CELESTE_AZULADO, RECTANGLE_OPACITY_LISTENING_SUBTITLES,
+                  COLOR_TEXTO_BLANCO, COLOR_TEXTO_OUTLINE_NEGRO),
+        draw_listening_label);
+
+    Mat outputImage = pooled_copy(backgroundImage);
+    compositeSprite(outputImage, label);
+    writer.write(output_filepath, outputImage);
+}
+
+// Rotulos de "Test": el verde abajo y el azul encima.
+void draw_test_labels(Mat& outputImage) {
+    Ptr<freetype::FreeType2> ft2 = font_registry.get(FONT_PATH);
+    const string& text_blue_rect = TEXTO_TEST_AZUL;
+    const string& text_green_rect = TEXTO_TEST_VERDE;
 
     // --- CÁLCULO Y DIBUJO DEL RECTÁNGULO VERDE (INFERIOR) ---
     int max_text_width_green = BASE_IMG_WIDTH - (2 * MARGIN_SIDES_DEFAULT) - (2 * PADDING_HORIZONTAL_TEST_GREEN);
-    vector<string> wrapped_lines_green = wrapText(ft2, text_green_rect, FONT_HEIGHT_TEST_GREEN, max_text_width_green);
+    vector<string> wrapped_lines_green = wrapLabelText(ft2, text_green_rect, FONT_HEIGHT_TEST_GREEN, max_text_width_green);
     
     int actual_wrapped_text_width_green = 0;
     for (const string& line : wrapped_lines_green) {
         actual_wrapped_text_width_green = max(actual_wrapped_text_width_green, ft2->getTextSize(line, FONT_HEIGHT_TEST_GREEN, -1, nullptr).width);
     }
 
-    int text_height_in_lines_green = calculateWrappedTextHeight(ft2, text_green_rect, FONT_HEIGHT_TEST_GREEN, max_text_width_green);
+    int text_height_in_lines_green = labelTextHeight(ft2, text_green_rect, FONT_HEIGHT_TEST_GREEN, max_text_width_green);
     
     int green_rect_width = actual_wrapped_text_width_green + (2 * PADDING_HORIZONTAL_TEST_GREEN);
     int green_rect_height = text_height_in_lines_green + (2 * PADDING_VERTICAL_TEST_GREEN);
@@ -327,14 +421,14 @@ void generate_test_image(const std::string& base_image_path, const std::string&
 
     // --- CÁLCULO Y DIBUJO DEL RECTÁNGULO AZUL (SUPERIOR) ---
     int max_text_width_blue = BASE_IMG_WIDTH - (2 * MARGIN_SIDES_DEFAULT) - (2 * PADDING_HORIZONTAL_TEST_BLUE);
-    vector<string> wrapped_lines_blue = wrapText(ft2, text_blue_rect, FONT_HEIGHT_TEST_BLUE, max_text_width_blue);
+    vector<string> wrapped_lines_blue = wrapLabelText(ft2, text_blue_rect, FONT_HEIGHT_TEST_BLUE, max_text_width_blue);
     
     int actual_wrapped_text_width_blue = 0;
     for (const string& line : wrapped_lines_blue) {
         actual_wrapped_text_width_blue = max(actual_wrapped_text_width_blue, ft2->getTextSize(line, FONT_HEIGHT_TEST_BLUE, -1, nullptr).width);
     }
 
-    int text_height_in_lines_blue = calculateWrappedTextHeight(ft2, text_blue_rect, FONT_HEIGHT_TEST_BLUE, max_text_width_blue);
+    int text_height_in_lines_blue = labelTextHeight(ft2, text_blue_rect, FONT_HEIGHT_TEST_BLUE, max_text_width_blue);
     
     int blue_rect_width = actual_wrapped_text_width_blue + (2 * PADDING_HORIZONTAL_TEST_BLUE);
     int blue_rect_height = text_height_in_lines_blue + (2 * PADDING_VERTICAL_TEST_BLUE);
@@ -346,125 +440,243 @@ void generate_test_image(const std::string& base_image_path, const std::string&
 
     Rect blueRect(blue_rect_x, blue_rect_y, blue_rect_width, blue_rect_height);
 
-    Mat outputImage = backgroundImage.clone();
-
     // Aplicar los rectángulos semi-transparentes (esquinas vivas)
     Mat roi_green = outputImage(greenRect);
-    Mat coloredOverlay_green(roi_green.size(), outputImage.type(), COLOR_RECTANGULO_VERDE_CLARO); 
-    addWeighted(coloredOverlay_green, RECTANGLE_OPACITY_TEST, roi_green, 1.0 - RECTANGLE_OPACITY_TEST, 0.0, roi_green);
+    blendConstantColor(roi_green, COLOR_RECTANGULO_VERDE_CLARO, RECTANGLE_OPACITY_TEST);
 
     Mat roi_blue = outputImage(blueRect);
-    Mat coloredOverlay_blue(roi_blue.size(), outputImage.type(), COLOR_RECTANGULO_CELESTE_AZULADO); 
-    addWeighted(coloredOverlay_blue, RECTANGLE_OPACITY_TEST, roi_blue, 1.0 - RECTANGLE_OPACITY_TEST, 0.0, roi_blue);
+    blendConstantColor(roi_blue, COLOR_RECTANGULO_CELESTE_AZULADO, RECTANGLE_OPACITY_TEST);
 
     // Dibujar el texto en los rectángulos con contorno
     drawWrappedTextWithOutline(outputImage, ft2, text_blue_rect, blueRect, FONT_HEIGHT_TEST_BLUE, COLOR_TEXTO_BLANCO, COLOR_TEXTO_OUTLINE_NEGRO, OUTLINE_THICKNESS, PADDING_HORIZONTAL_TEST_BLUE, PADDING_VERTICAL_TEST_BLUE);
     drawWrappedTextWithOutline(outputImage, ft2, text_green_rect, greenRect, FONT_HEIGHT_TEST_GREEN, COLOR_TEXTO_BLANCO, COLOR_TEXTO_OUTLINE_NEGRO, OUTLINE_THICKNESS, PADDING_HORIZONTAL_TEST_GREEN, PADDING_VERTICAL_TEST_GREEN);
-
-    imwrite(output_filepath, outputImage);
-    cout << "✅ Imagen generada: " << output_filepath << endl;
 }
 
-// Function to overlay subtitle text onto an existing image (for English/Spanish subtitles)
-void overlay_subtitle_text_image(const std::string& base_image_path, const std::string& output_filepath, const std::string& text_content, int font_height) {
-    Mat backgroundImage = imread(base_image_path);
+// Function to generate the "Test" image (Fondo con Test style)
+void generate_test_image(BackgroundCache& backgrounds, AsyncFrameWriter& writer, const std::string& base_image_path, const std::string& output_filepath) {
+    const Mat& backgroundImage = backgrounds.get(base_image_path, Size(BASE_IMG_WIDTH, BASE_IMG_HEIGHT));
     if (backgroundImage.empty()) {
-        cerr << "Error: No se pudo cargar la imagen base desde '" << base_image_path << "' para Subtitle Overlay." << endl;
-        exit(EXIT_FAILURE);
+        throw std::runtime_error("No se pudo cargar la imagen base desde '" + base_image_path + "' para Test Image.");
     }
-    resize(backgroundImage, backgroundImage, Size(BASE_IMG_WIDTH, BASE_IMG_HEIGHT), 0, 0, INTER_LINEAR);
 
-    Ptr<freetype::FreeType2> ft2 = freetype::createFreeType2();
-    try {
-        ft2->loadFontData(FONT_PATH, 0);
-    } catch (const cv::Exception& e) {
-        cerr << "Error: No se pudo cargar la fuente '" << FONT_PATH << "'. Asegurese de que este en el mismo directorio que el ejecutable." << endl;
-        cerr << "Error de OpenCV FreeType: " << e.what() << endl;
-        exit(EXIT_FAILURE);
-    }
-    
-    int max_text_width_for_wrap = BASE_IMG_WIDTH - (2 * MARGIN_SIDES_DEFAULT) - (2 * PADDING_HORIZONTAL_SUBTITLES);
-    vector<string> wrapped_lines = wrapText(ft2, text_content, font_height, max_text_width_for_wrap);
-    
-    int actual_wrapped_text_width = 0;
-    for (const string& line : wrapped_lines) {
-        actual_wrapped_text_width = max(actual_wrapped_text_width, ft2->getTextSize(line, font_height, -1, nullptr).width);
-    }
+    const LabelSprite& labels = label_sprites.get(
+        label_key("test", TEXTO_TEST_AZUL, TEXTO_TEST_VERDE, FONT_HEIGHT_TEST_BLUE, FONT_HEIGHT_TEST_GREEN,
+                  PADDING_HORIZONTAL_TEST_BLUE, PADDING_VERTICAL_TEST_BLUE, PADDING_HORIZONTAL_TEST_GREEN, PADDING_VERTICAL_TEST_GREEN,
+                  MARGIN_SIDES_DEFAULT, MARGIN_BOTTOM_DEFAULT, SPACING_BETWEEN_TEST_RECTS, COLOR_RECTANGULO_CELESTE_AZULADO,
+                  COLOR_RECTANGULO_VERDE_CLARO, RECTANGLE_OPACITY_TEST, COLOR_TEXTO_BLANCO, COLOR_TEXTO_OUTLINE_NEGRO),
+        draw_test_labels);
 
-    int text_height_in_lines = calculateWrappedTextHeight(ft2, text_content, font_height, max_text_width_for_wrap);
-    
-    int rect_width = actual_wrapped_text_width + (2 * PADDING_HORIZONTAL_SUBTITLES);
-    int rect_height = text_height_in_lines + (2 * PADDING_VERTICAL_SUBTITLES);
+    Mat outputImage = pooled_copy(backgroundImage);
+    compositeSprite(outputImage, labels);
+    writer.write(output_filepath, outputImage);
+}
 
-    rect_width = min(rect_width, BASE_IMG_WIDTH - (2 * MARGIN_SIDES_DEFAULT));
+// Function to overlay subtitle text onto an existing frame (for English/Spanish subtitles)
+void overlay_subtitle_text_image(AsyncFrameWriter& writer, const FrameManifest& manifest, int frame_number, const std::string& output_filepath, const std::string& text_content, int font_height) {
+    Mat backgroundImage = load_frame(manifest, "imagenes_generadas", frame_number);
+    if (backgroundImage.empty()) {
+        throw std::runtime_error("No se pudo cargar la imagen base desde '" + frame_path(manifest, "imagenes_generadas", frame_number) + "' para Subtitle Overlay.");
+    }
+    if (backgroundImage.size() != Size(BASE_IMG_WIDTH, BASE_IMG_HEIGHT)) {
+        resize(backgroundImage, backgroundImage, Size(BASE_IMG_WIDTH, BASE_IMG_HEIGHT), 0, 0, INTER_LINEAR);
+    }
 
-    int rect_x = (BASE_IMG_WIDTH - rect_width) / 2; // Centrado horizontalmente
-    int rect_y = MARGIN_TOP_DEFAULT; // Posición en la parte superior
+    const LabelSprite& label = label_sprites.get(
+        label_key("subtitulos", text_content, font_height, PADDING_HORIZONTAL_SUBTITLES, PADDING_VERTICAL_SUBTITLES,
+                  MARGIN_SIDES_DEFAULT, MARGIN_TOP_DEFAULT, COLOR_RECTANGULO_CELESTE_AZULADO, RECTANGLE_OPACITY_LISTENING_SUBTITLES,
+                  COLOR_TEXTO_BLANCO, COLOR_TEXTO_OUTLINE_NEGRO),
+        [&](Mat& image) { drawSubtitleLabel(image, font_registry.get(FONT_PATH), text_content, font_height); });
 
-    Rect mainRect(rect_x, rect_y, rect_width, rect_height);
+    // load_frame devuelve un buffer propio: se compone encima sin copiarlo
+    compositeSprite(backgroundImage, label);
+    writer.write(output_filepath, backgroundImage);
+}
 
-    Mat outputImage = backgroundImage.clone();
+// Ejecuta los trabajos repartidos entre `threads` hilos (0 = uno por hilo de hardware). Cada
+// trabajo escribe su propio archivo y todo lo compartido (fondos, rotulos, buffers y escritor)
+// es seguro entre hilos, asi que el resultado es el mismo que en serie.
+// Los trabajos informan de un error lanzando una excepcion: nunca llaman a exit(), que
+// destruiria los objetos globales mientras los demas hilos y el escritor aun los usan. El
+// primer error se muestra, los hilos dejan de tomar trabajos nuevos y run_parallel devuelve
+// false una vez terminados todos.
+bool run_parallel(const std::vector<std::function<void()>>& jobs, int threads) {
+    if (threads <= 0) threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    threads = static_cast<int>(std::min<size_t>(threads, std::max<size_t>(1, jobs.size())));
+    std::atomic<size_t> next_job{0};
+    std::atomic<bool> failed{false};
+    auto worker = [&]() {
+        for (size_t i = next_job++; i < jobs.size() && !failed; i = next_job++) {
+            try {
+                jobs[i]();
+            } catch (const std::exception& e) {
+                if (!failed.exchange(true)) {
+                    std::lock_guard<std::mutex> lock(consoleMutex);
+                    cerr << "Error: " << e.what() << endl;
+                }
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i) {
+        workers.emplace_back(worker);
+    }
+    worker(); // El hilo principal tambien trabaja
+    for (std::thread& t : workers) {
+        t.join();
+    }
+    return !failed;
+}
 
-    // Aplicar el rectángulo semi-transparente
-    Mat roi = outputImage(mainRect);
-    Mat coloredOverlay(roi.size(), outputImage.type(), COLOR_RECTANGULO_CELESTE_AZULADO); 
-    addWeighted(coloredOverlay, RECTANGLE_OPACITY_LISTENING_SUBTITLES, roi, 1.0 - RECTANGLE_OPACITY_LISTENING_SUBTITLES, 0.0, roi);
 
-    // Dibujar el texto sobre el rectángulo con contorno
-    drawWrappedTextWithOutline(outputImage, ft2, text_content, mainRect, font_height, COLOR_TEXTO_BLANCO, COLOR_TEXTO_OUTLINE_NEGRO, OUTLINE_THICKNESS, PADDING_HORIZONTAL_SUBTITLES, PADDING_VERTICAL_SUBTITLES);
+int main(int argc, char* argv[]) {
+    int threads = 0; // Hilos que generan imagenes; 0 = uno por hilo de hardware
+    // Opciones del escritor asincrono de imagenes
+    int encoder_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / 2);
+    int queue_capacity = 16;
+    int png_compression = -1; // -1 = configuracion por defecto de OpenCV
+    FrameFormat format = FrameFormat::Png;
+    bool draft = false; // Vista previa: imagenes a la mitad de ancho y alto, PNG de compresion minima
+    // Solo las imagenes de Listening y Test: las de subtitulos ya las escribio imagenes.exe --rotulos
+    // al renderizar los frames, asi que no se leen IndicesImagenes.txt ni los frames.
+    bool backgrounds_only = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--formato") {
+            if (i + 1 >= argc || !parseFrameFormat(argv[++i], format)) {
+                cerr << "Error: '--formato' espera png, qoi, webp o bmp." << endl;
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+        if (arg == "--draft") {
+            draft = true;
+            continue;
+        }
+        if (arg == "--solo-fondos") {
+            backgrounds_only = true;
+            continue;
+        }
+        int* target = nullptr;
+        if (arg == "--hilos") target = &threads;
+        else if (arg == "--hilos-escritura") target = &encoder_threads;
+        else if (arg == "--cola-frames") target = &queue_capacity;
+        else if (arg == "--compresion-png") target = &png_compression;
+        if (target == nullptr || i + 1 >= argc) {
+            cerr << "Error: Argumento invalido '" << arg << "'." << endl;
+            cerr << "Uso: image_preprocessor.exe [--hilos N] [--hilos-escritura N] [--cola-frames N] [--compresion-png 0-9] [--formato png|qoi|webp|bmp] [--draft] [--solo-fondos]" << endl;
+            return EXIT_FAILURE;
+        }
+        try {
+            *target = std::stoi(argv[++i]);
+        } catch (const std::exception&) {
+            cerr << "Error: '" << arg << "' espera un numero entero." << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    Size output_size;
+    if (draft) {
+        // Mismo tamano que los frames de imagenes.exe --draft
+        output_size = Size(BASE_IMG_WIDTH / 2, BASE_IMG_HEIGHT / 2);
+        if (png_compression < 0) png_compression = 1;
+        cout << "Modo borrador: imagenes de " << output_size.width << "x" << output_size.height << "." << endl;
+    }
+    AsyncFrameWriter writer(encoder_threads, static_cast<size_t>(std::max(1, queue_capacity)), format, png_compression, output_size);
 
-    imwrite(output_filepath, outputImage);
-    cout << "✅ Imagen generada: " << output_filepath << endl;
-}
+    // Read indices from file
+    IndicesData indices;
+    FrameManifest frame_manifest;
+    if (!backgrounds_only) {
+        if (!read_indices_file("IndicesImagenes.txt", indices)) {
+            return EXIT_FAILURE;
+        }
+        frame_manifest = read_frame_manifest("imagenes_generadas");
 
+        // Asegurarse de que los directorios de salida existan
+        fs::create_directories("imagenes_generadas");
+        fs::create_directories("Imagenes_English");
+        fs::create_directories("Imagenes_Spanish");
+    }
 
-int main() {
-    // Read indices from file
-    IndicesData indices = read_indices_file("IndicesImagenes.txt");
+    // Fondos de personajes (personajes/<numero>.png); cada uno se decodifica una sola vez
+    BackgroundCache backgrounds;
+    std::vector<std::string> background_paths = listBackgroundImages("personajes");
+    if (background_paths.empty()) {
+        cerr << "Error: No se encontraron imagenes de fondo numeradas en la carpeta 'personajes'." << endl;
+        return EXIT_FAILURE;
+    }
 
-    // Asegurarse de que los directorios de salida existan
-    fs::create_directories("imagenes_generadas");
-    fs::create_directories("Imagenes_English");
-    fs::create_directories("Imagenes_Spanish");
+    // Cada imagen es un trabajo independiente (leer, componer, encolar la escritura); se
+    // reparten entre los hilos de generacion con run_parallel.
+    std::vector<std::function<void()>> jobs;
+    auto warn = [](const std::string& message) {
+        std::lock_guard<std::mutex> lock(consoleMutex);
+        cerr << message << endl;
+    };
 
     // --- Generar imágenes "Listening" (Fondo Sin Subtítulos) ---
-    cout << "\nGenerando imagenes de Listening (Fondo Sin Subtitulos)..." << endl;
-    generate_listening_image("personajes/1000.png", "personajes/1000_Listening.png");
-    generate_listening_image("personajes/2000.png", "personajes/2000_Listening.png");
+    for (const std::string& background_path : background_paths) {
+        std::string stem = background_path.substr(0, background_path.size() - 4); // Sin ".png"
+        jobs.push_back([&, background_path, stem]() {
+            generate_listening_image(backgrounds, writer, background_path, stem + "_Listening" + writer.extension());
+        });
+    }
 
     // --- Generar imágenes "Test" (Fondo con Test) ---
-    cout << "\nGenerando imagenes de Test (Fondo con Test)..." << endl;
-    generate_test_image("personajes/1000.png", "personajes/1000_Test.png");
-    generate_test_image("personajes/2000.png", "personajes/2000_Test.png");
+    for (const std::string& background_path : background_paths) {
+        std::string stem = background_path.substr(0, background_path.size() - 4); // Sin ".png"
+        jobs.push_back([&, background_path, stem]() {
+            generate_test_image(backgrounds, writer, background_path, stem + "_Test" + writer.extension());
+        });
+    }
 
     // --- Generar imágenes para "Fondo con subtitulos en inglés" ---
-    cout << "\nGenerando imagenes para Fondo con subtitulos en ingles..." << endl;
     for (int img_idx : indices.english_only_images) {
-        string source_img_path = "imagenes_generadas/" + std::to_string(img_idx) + ".png";
-        string output_img_path = "Imagenes_English/" + std::to_string(img_idx) + ".png";
-        // Necesitas asegurarte de que imagenes_generadas/{index}.png exista antes de esto.
-        // Si no existen, este programa los saltará o dará error.
-        // Para la demo, asumimos que ya existen o se generarán por otro lado.
-        // Si no es así, esta parte deberá ser parte de un flujo más amplio.
-        if (fs::exists(source_img_path)) {
-            overlay_subtitle_text_image(source_img_path, output_img_path, "Escucha con subtítulos en Inglés", FONT_HEIGHT_SUBTITLES_EN);
-        } else {
-            cerr << "Advertencia: La imagen original " << source_img_path << " no existe. No se puede generar la imagen para subtítulos en ingles." << endl;
-        }
+        jobs.push_back([&, img_idx]() {
+            string source_img_path = frame_path(frame_manifest, "imagenes_generadas", img_idx);
+            string output_img_path = "Imagenes_English/" + std::to_string(img_idx) + writer.extension();
+            // Necesitas asegurarte de que el frame {index} exista (segun el manifiesto) antes de esto.
+            // Si no existen, este programa los saltará o dará error.
+            // Para la demo, asumimos que ya existen o se generarán por otro lado.
+            // Si no es así, esta parte deberá ser parte de un flujo más amplio.
+            if (fs::exists(source_img_path)) {
+                overlay_subtitle_text_image(writer, frame_manifest, img_idx, output_img_path, TEXTO_SUBTITULOS_EN, FONT_HEIGHT_SUBTITLES_EN);
+            } else {
+                warn("Advertencia: La imagen original " + source_img_path + " no existe. No se puede generar la imagen para subtítulos en ingles.");
+            }
+        });
     }
 
     // --- Generar imágenes para "Fondo con subtitulos en y español" ---
-    cout << "\nGenerando imagenes para Fondo con subtitulos en ingles y espanol..." << endl;
     for (int img_idx : indices.english_spanish_images) {
-        string source_img_path = "imagenes_generadas/" + std::to_string(img_idx) + ".png";
-        string output_img_path = "Imagenes_Spanish/" + std::to_string(img_idx) + ".png";
-        if (fs::exists(source_img_path)) {
-            overlay_subtitle_text_image(source_img_path, output_img_path, "Escucha con subtítulos en Inglés y Español", FONT_HEIGHT_SUBTITLES_EN_ES);
-        } else {
-            cerr << "Advertencia: La imagen original " << source_img_path << " no existe. No se puede generar la imagen para subtítulos en ingles y espanol." << endl;
-        }
+        jobs.push_back([&, img_idx]() {
+            string source_img_path = frame_path(frame_manifest, "imagenes_generadas", img_idx);
+            string output_img_path = "Imagenes_Spanish/" + std::to_string(img_idx) + writer.extension();
+            if (fs::exists(source_img_path)) {
+                overlay_subtitle_text_image(writer, frame_manifest, img_idx, output_img_path, TEXTO_SUBTITULOS_EN_ES, FONT_HEIGHT_SUBTITLES_EN_ES);
+            } else {
+                warn("Advertencia: La imagen original " + source_img_path + " no existe. No se puede generar la imagen para subtítulos en ingles y espanol.");
+            }
+        });
     }
 
+    if (backgrounds_only) {
+        cout << "\nLas imagenes con subtitulos ya las genero imagenes.exe --rotulos." << endl;
+    }
+    cout << "\nGenerando " << jobs.size() << " imagenes: " << background_paths.size() << " de Listening, "
+         << background_paths.size() << " de Test, " << indices.english_only_images.size() << " con subtitulos en ingles y "
+         << indices.english_spanish_images.size() << " con subtitulos en ingles y espanol ("
+         << (threads > 0 ? std::to_string(threads) + " hilo(s)" : "un hilo por nucleo") << ")..." << endl;
+    const bool generated = run_parallel(jobs, threads);
+
+    // Las imagenes ya encoladas se terminan de escribir tambien si algun trabajo fallo
+    if (!writer.finish()) {
+        cerr << "Error: No se pudieron escribir algunas imagenes." << endl;
+        return EXIT_FAILURE;
+    }
+    if (!generated) {
+        cerr << "Error: No se generaron todas las imagenes." << endl;
+        return EXIT_FAILURE;
+    }
     cout << "\nProceso de preprocesamiento de imagenes completado." << endl;
  
 
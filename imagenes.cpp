@@ -12,6 +12,25 @@
 #include <algorithm> // For std::min and std::max
 #include <cctype>    // For isspace
 #include <filesystem> // For std::filesystem operations
+#include <unordered_map> // For the glyph atlas
+#include <climits>   // For INT_MAX and INT_MIN
+#include <cstring>   // For memcpy
+#include <cstdint>   // For uint64_t
+#include <map>       // For the frame manifest
+#include <iomanip>   // For std::setw and std::setfill
+#include <thread>    // For the parallel phrase renderer
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <chrono>    // For the blend benchmark
+#include <set>
+#include <cmath>     // For llround
+#include <cstdio>    // For the encoder pipe
+#include <lz4.h>     // For the compressed frame cache (bundled with the vcpkg OpenCV build)
+#include <process.h> // For _getpid, to name the frame cache's spill directory
+#include <random>
+#include "frame_io.hpp" // Frame formats, encoders, buffer pool, blend kernel and backgrounds
 
 using namespace cv;
 using namespace std;
@@ -28,6 +47,16 @@ const Scalar COLOR_TEXTO_SUBFRASE_NUEVO = Scalar(99, 191, 0);
 const Scalar COLOR_TEXTO_ESPANOL_NUEVO = Scalar(255, 255, 255);
 
 const string ARCHIVO_PLANTILLA = "Excel.txt";
+const string ARCHIVO_MANIFIESTO = "manifiesto_frames.txt"; // Inside the output directory
+const string ARCHIVO_CACHE_FRASES = "cache_frases.txt";     // Inside the output directory, --incremental
+// Part of every phrase signature (--incremental). Bump when a change to the drawing code alters
+// the pixels, so frames cached by an older build are rendered again:
+//   1  first cached frames
+//   2  backgrounds centre-cropped instead of stretched; panel and text layout reworked for
+//      --auto-ajuste and the 4:2:0 band of --yuv
+//   3  glyph pairs kerned as FreeType2::putText kerns them
+const int VERSION_RENDER = 3;
+const string CARPETA_PERSONAJES = "personajes";
 const int LINE_SPACING = 40;
 const int RECT_VERTICAL_PADDING = 40;
 
@@ -35,6 +64,22 @@ const int TOP_TEXT_OFFSET_FRAGMENTO = 20;
 const int BOTTOM_TEXT_OFFSET_ESPANOL = -20;
 const double RECTANGLE_OPACITY = 0.85;
 
+// Layout of the text panel at the bottom of each frame
+const int SECTION_SPACING = 20;
+const int MIN_HEIGHT_EN_SECTION = 120;
+const int MIN_HEIGHT_ES_SECTION = 80;
+const int HEIGHT_FRAGMENTO_ES_SECTION = 80;
+
+const int FONT_HEIGHT_EN = static_cast<int>(75 * 1.15);
+const int FONT_HEIGHT_ES = static_cast<int>(55 * 1.15);
+const int FONT_HEIGHT_FRAGMENTO_ES = static_cast<int>(50 * 1.15);
+const int AUTO_FIT_MIN_PERCENT = 60; // --auto-ajuste never shrinks text below this share of the sizes above
+
+// Folders of the labelled English-only and English+Spanish frames (--rotulos). The labels'
+// style and texts are shared with image_preprocessor.cpp through frame_io.hpp.
+const string CARPETA_ROTULO_INGLES = "Imagenes_English";
+const string CARPETA_ROTULO_INGLES_ESPANOL = "Imagenes_Spanish";
+
 // Function to remove leading and trailing whitespace from a string
 string trim(const string& str) {
     size_t first = str.find_first_not_of(" \t\n\r\f\v");
@@ -50,215 +95,1619 @@ void drawSharpRect(Mat& img, Rect rect, Scalar color) {
     rectangle(img, rect, color, -1, LINE_AA); // -1 for filled
 }
 
-// Wraps text into multiple lines to fit within maxWidth.
-// Returns only the lines of text.
-vector<string> wrapText(Ptr<freetype::FreeType2> ft2, const string& text, int fontHeight, int maxWidth) {
-    vector<string> lines;
-    stringstream ss(text);
-    string word;
-    string currentLine;
-    bool firstWordInLine = true;
+// Decodes the codepoint starting at byte i and moves i past it. Malformed bytes are passed
+// through as-is.
+char32_t nextCodepoint(const string& text, size_t& i) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    int extra = 0;
+    char32_t cp = c;
+    if (c >= 0xF0 && c <= 0xF7) { extra = 3; cp = c & 0x07; }
+    else if (c >= 0xE0) { extra = (c <= 0xEF) ? 2 : 0; cp = (c <= 0xEF) ? (c & 0x0F) : c; }
+    else if (c >= 0xC0) { extra = 1; cp = c & 0x1F; }
+
+    bool valid = i + extra < text.size() || extra == 0;
+    for (int k = 1; valid && k <= extra; ++k) {
+        unsigned char cc = static_cast<unsigned char>(text[i + k]);
+        if ((cc & 0xC0) != 0x80) valid = false;
+        else cp = (cp << 6) | (cc & 0x3F);
+    }
+    if (!valid) { cp = c; extra = 0; }
+    i += extra + 1;
+    return cp;
+}
 
-    while (ss >> word) {
-        string testLine = currentLine;
-        if (!firstWordInLine) {
-            testLine += " ";
-        }
-        testLine += word;
+// Decodes a UTF-8 string into Unicode codepoints. Malformed bytes are passed through as-is.
+vector<char32_t> decodeUtf8(const string& text) {
+    vector<char32_t> codepoints;
+    codepoints.reserve(text.size());
+    size_t i = 0;
+    while (i < text.size()) codepoints.push_back(nextCodepoint(text, i));
+    return codepoints;
+}
 
-        Size textSize = ft2->getTextSize(testLine, fontHeight, -1, nullptr);
+// Encodes a single Unicode codepoint as UTF-8.
+string encodeUtf8(char32_t cp) {
+    string out;
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    return out;
+}
 
-        if (textSize.width <= maxWidth) {
-            currentLine = testLine;
-        } else {
-            if (!currentLine.empty()) {
-                lines.push_back(currentLine);
+// A glyph rasterized once through FreeType: its coverage mask and where it sits
+// relative to the pen position on the baseline.
+struct CachedGlyph {
+    Mat coverage;      // CV_8UC1 alpha mask, empty for blank glyphs such as the space
+    Point offset;      // Top-left corner of the mask relative to the pen position
+    int advance = 0;   // Horizontal pen advance in pixels
+};
+
+// A string laid out on the baseline: each glyph with its pen offset from the origin and the
+// byte offset in the string of the codepoint it was drawn from (its cluster).
+struct ShapedGlyph {
+    const CachedGlyph* glyph;
+    int x;
+    int cluster;
+};
+
+struct ShapedRun {
+    vector<ShapedGlyph> glyphs;
+    Size size; // Bounding box, as getTextSize reports it
+};
+
+// Glyph atlas for one font face. Glyphs are rasterized and measured through FreeType the first
+// time a (pixel height, codepoint) pair is seen; after that text is measured from the cached
+// metrics and drawn by blitting the cached coverage masks. With one atlas per font, entries are
+// effectively keyed by (font, pixel height, codepoint).
+// FreeType's hinted advances are whole pixels, so glyphs never land on sub-pixel positions and a
+// single mask per glyph reproduces what FreeType2::putText draws. putText shapes the whole string
+// with HarfBuzz, which kerns pairs such as "AV" or "To"; the atlas measures that correction once
+// per (pixel height, pair) and adds it between the two glyphs.
+class GlyphAtlas {
+public:
+    GlyphAtlas(Ptr<freetype::FreeType2> ft2, const string& fontName) : ft2(ft2), fontName(fontName) {}
+
+    const string& font() const { return fontName; }
+
+    const CachedGlyph& glyph(int fontHeight, char32_t codepoint) {
+        uint64_t key = (static_cast<uint64_t>(fontHeight) << 32) | static_cast<uint64_t>(codepoint);
+        auto it = glyphs.find(key);
+        if (it != glyphs.end()) return it->second;
+        return glyphs.emplace(key, rasterize(fontHeight, codepoint)).first->second;
+    }
+
+    // Pen correction HarfBuzz applies between two adjacent glyphs (negative for "AV"): what
+    // the pair is wider or narrower than the two advances on their own.
+    int kerning(int fontHeight, char32_t left, char32_t right) {
+        uint64_t key = (static_cast<uint64_t>(fontHeight) << 42) | (static_cast<uint64_t>(left) << 21) | static_cast<uint64_t>(right);
+        auto it = pairs.find(key);
+        if (it != pairs.end()) return it->second;
+        int pairAdvance = ft2->getTextSize("I" + encodeUtf8(left) + encodeUtf8(right) + "I", fontHeight, -1, nullptr).width - referenceWidth(fontHeight);
+        int correction = pairAdvance - glyph(fontHeight, left).advance - glyph(fontHeight, right).advance;
+        pairs[key] = correction;
+        return correction;
+    }
+
+    // Height of "Tg" at the given size; the renderer steps lines by this amount.
+    int lineHeight(int fontHeight) {
+        auto it = lineHeights.find(fontHeight);
+        if (it != lineHeights.end()) return it->second;
+        int height = ft2->getTextSize("Tg", fontHeight, -1, nullptr).height;
+        lineHeights[fontHeight] = height;
+        return height;
+    }
+
+    // Shaped run of a string, built once per distinct (string, pixel height): the same
+    // sentences and fragments are measured and drawn in several frames of a phrase, and
+    // this skips the UTF-8 decoding and glyph lookups after the first time.
+    const ShapedRun& shape(const string& text, int fontHeight) {
+        string key = to_string(fontHeight) + '\x1f' + text;
+        auto it = runs.find(key);
+        if (it != runs.end()) {
+            runHits++;
+            return it->second;
+        }
+        runMisses++;
+
+        // Bounding box following FreeType2::getTextSize: blank glyphs contribute a box
+        // spanning their advance so trailing spaces still count.
+        ShapedRun run;
+        int pen = 0;
+        int xMin = INT_MAX, xMax = INT_MIN, yMin = INT_MAX, yMax = INT_MIN;
+        size_t i = 0;
+        char32_t previous = 0;
+        while (i < text.size()) {
+            int cluster = static_cast<int>(i);
+            char32_t cp = nextCodepoint(text, i);
+            if (previous != 0) pen += kerning(fontHeight, previous, cp);
+            previous = cp;
+            const CachedGlyph& g = glyph(fontHeight, cp);
+            run.glyphs.push_back({&g, pen, cluster});
+            if (!g.coverage.empty()) {
+                xMin = min(xMin, pen + g.offset.x);
+                xMax = max(xMax, pen + g.offset.x + g.coverage.cols);
+                yMin = min(yMin, g.offset.y);
+                yMax = max(yMax, g.offset.y + g.coverage.rows);
+            } else {
+                xMin = min(xMin, pen);
+                xMax = max(xMax, pen + g.advance);
             }
-            currentLine = word;
-            firstWordInLine = true; // Reset for the new line
+            pen += g.advance;
         }
-        firstWordInLine = false;
-    }
-    if (!currentLine.empty()) {
-        lines.push_back(currentLine);
+        if (xMin <= xMax) run.size = Size(xMax - xMin, yMin > yMax ? 0 : yMax - yMin);
+        return runs.emplace(std::move(key), std::move(run)).first->second;
     }
-    return lines;
-}
 
-// Wraps text and returns lines with their original start indices.
-vector<pair<string, int>> wrapTextAndOriginalIndices(Ptr<freetype::FreeType2> ft2, const string& text, int fontHeight, int maxWidth) {
-    vector<pair<string, int>> lines_with_indices;
-    string currentLineContent;
-    int currentLineOriginalStartIndex = 0;
+    size_t shapeHits() const { return runHits; }
+    size_t shapeMisses() const { return runMisses; }
+
+    // Bounding box of the rendered text, following FreeType2::getTextSize.
+    Size getTextSize(const string& text, int fontHeight) {
+        return shape(text, fontHeight).size;
+    }
 
-    vector<pair<string, int>> words_with_original_indices;
-    size_t current_char_pos = 0;
-    while (current_char_pos < text.length()) {
-        while (current_char_pos < text.length() && isspace(text[current_char_pos])) {
-            current_char_pos++;
+    // Draws text with its baseline starting at org, like FreeType2::putText with
+    // LINE_AA and bottomLeftOrigin = true. img must be CV_8UC3.
+    void putText(Mat& img, const string& text, Point org, int fontHeight, const Scalar& color) {
+        for (const ShapedGlyph& sg : shape(text, fontHeight).glyphs) {
+            blitGlyph(img, *sg.glyph, Point(org.x + sg.x, org.y), color);
         }
-        if (current_char_pos == text.length()) break;
+    }
 
-        size_t word_start = current_char_pos;
-        while (current_char_pos < text.length() && !isspace(text[current_char_pos])) {
-            current_char_pos++;
+    // Alpha-blends a cached coverage mask in the given colour, clipped to the image.
+    static void blitGlyph(Mat& img, const CachedGlyph& g, Point pen, const Scalar& color) {
+        if (g.coverage.empty()) return;
+        Rect target(pen.x + g.offset.x, pen.y + g.offset.y, g.coverage.cols, g.coverage.rows);
+        Rect clipped = target & Rect(0, 0, img.cols, img.rows);
+        if (clipped.width <= 0 || clipped.height <= 0) return;
+
+        const int c0 = static_cast<int>(color[0]), c1 = static_cast<int>(color[1]), c2 = static_cast<int>(color[2]);
+        for (int y = clipped.y; y < clipped.y + clipped.height; ++y) {
+            const uchar* mask = g.coverage.ptr<uchar>(y - target.y) + (clipped.x - target.x);
+            uchar* px = img.ptr<uchar>(y) + clipped.x * 3;
+            for (int x = 0; x < clipped.width; ++x, px += 3) {
+                int a = mask[x];
+                if (a == 0) continue;
+                if (a == 255) {
+                    px[0] = static_cast<uchar>(c0); px[1] = static_cast<uchar>(c1); px[2] = static_cast<uchar>(c2);
+                    continue;
+                }
+                int ia = 255 - a;
+                px[0] = static_cast<uchar>((c0 * a + px[0] * ia + 127) / 255);
+                px[1] = static_cast<uchar>((c1 * a + px[1] * ia + 127) / 255);
+                px[2] = static_cast<uchar>((c2 * a + px[2] * ia + 127) / 255);
+            }
         }
-        string word = text.substr(word_start, current_char_pos - word_start);
-        words_with_original_indices.push_back({word, static_cast<int>(word_start)});
     }
 
-    if (words_with_original_indices.empty()) {
-        return lines_with_indices;
+private:
+    CachedGlyph rasterize(int fontHeight, char32_t codepoint) {
+        CachedGlyph g;
+        string utf8 = encodeUtf8(codepoint);
+
+        // The advance is the distance the glyph pushes the following glyph: measure it
+        // between two reference bars so side bearings cancel out.
+        g.advance = max(0, ft2->getTextSize("I" + utf8 + "I", fontHeight, -1, nullptr).width - referenceWidth(fontHeight));
+
+        // Rasterize white-on-black so the blended result is exactly the coverage value.
+        Point pen(fontHeight, 2 * fontHeight);
+        Mat canvas(3 * fontHeight, g.advance + 3 * fontHeight, CV_8UC3, Scalar::all(0));
+        ft2->putText(canvas, utf8, pen, fontHeight, Scalar::all(255), -1, LINE_AA, true);
+        Mat coverage;
+        extractChannel(canvas, coverage, 0);
+
+        vector<Point> inked;
+        findNonZero(coverage, inked);
+        if (!inked.empty()) {
+            Rect box = boundingRect(inked);
+            g.coverage = coverage(box).clone();
+            g.offset = Point(box.x - pen.x, box.y - pen.y);
+        }
+        return g;
     }
 
-    currentLineContent = words_with_original_indices[0].first;
-    currentLineOriginalStartIndex = words_with_original_indices[0].second;
+    // Width of "II", subtracted from a glyph measured between two bars.
+    int referenceWidth(int fontHeight) {
+        auto it = referenceWidths.find(fontHeight);
+        if (it != referenceWidths.end()) return it->second;
+        return referenceWidths.emplace(fontHeight, ft2->getTextSize("II", fontHeight, -1, nullptr).width).first->second;
+    }
 
-    for (size_t i = 1; i < words_with_original_indices.size(); ++i) {
-        string nextWord = words_with_original_indices[i].first;
-        int nextWordOriginalIndex = words_with_original_indices[i].second;
+    Ptr<freetype::FreeType2> ft2;
+    string fontName;
+    unordered_map<uint64_t, CachedGlyph> glyphs;
+    unordered_map<uint64_t, int> pairs;
+    unordered_map<int, int> lineHeights;
+    unordered_map<int, int> referenceWidths;
+    unordered_map<string, ShapedRun> runs;
+    size_t runHits = 0;
+    size_t runMisses = 0;
+};
+
+// One wrapped line of a LayoutResult.
+struct LayoutLine {
+    string text;          // Words of the line joined by single spaces
+    int sourceStart = 0;  // Byte offset of the line's first word in the laid-out text
+    int width = 0;        // Rendered width in pixels
+    int baselineOffset = 0; // Baseline relative to the top of the text block
+};
+
+// Wrapped text, shared by the height calculation and the drawing code.
+struct LayoutResult {
+    vector<LayoutLine> lines;
+    int lineHeight = 0;
+    int totalHeight = 0;
+};
+
+// Wraps text in linear time: every word and the space advance are measured once from the
+// glyph atlas, and line widths are accumulated instead of re-measuring the whole line for
+// each added word. Results are memoized per (text, font height, width, line spacing).
+class TextLayoutEngine {
+public:
+    explicit TextLayoutEngine(GlyphAtlas& atlas) : atlas(atlas) {}
+
+    GlyphAtlas& glyphs() { return atlas; }
+
+    const LayoutResult& layout(const string& text, int fontHeight, int maxWidth, int lineSpacing = LINE_SPACING) {
+        string key = to_string(fontHeight) + '\x1f' + to_string(maxWidth) + '\x1f' + to_string(lineSpacing) + '\x1f' + text;
+        auto it = layouts.find(key);
+        if (it != layouts.end()) return it->second;
+        return layouts.emplace(std::move(key), wrap(text, fontHeight, maxWidth, lineSpacing)).first->second;
+    }
 
-        string testLine = currentLineContent;
-        if (!currentLineContent.empty()) {
-            testLine += " ";
+private:
+    // Horizontal extent of a word relative to its pen position, following the
+    // bounding-box rules of GlyphAtlas::getTextSize.
+    struct WordMetrics {
+        int advance = 0;
+        int left = 0;
+        int right = 0;
+        char32_t first = 0; // First and last codepoints, to kern the word against the spaces around it
+        char32_t last = 0;
+    };
+
+    const WordMetrics& measureWord(const string& word, int fontHeight) {
+        string key = to_string(fontHeight) + '\x1f' + word;
+        auto it = words.find(key);
+        if (it != words.end()) return it->second;
+
+        WordMetrics m;
+        int xMin = INT_MAX, xMax = INT_MIN;
+        for (char32_t cp : decodeUtf8(word)) {
+            if (m.last != 0) m.advance += atlas.kerning(fontHeight, m.last, cp);
+            if (m.first == 0) m.first = cp;
+            m.last = cp;
+            const CachedGlyph& g = atlas.glyph(fontHeight, cp);
+            int left = g.coverage.empty() ? m.advance : m.advance + g.offset.x;
+            int right = g.coverage.empty() ? m.advance + g.advance : left + g.coverage.cols;
+            xMin = min(xMin, left);
+            xMax = max(xMax, right);
+            m.advance += g.advance;
         }
-        testLine += nextWord;
+        if (xMin <= xMax) {
+            m.left = xMin;
+            m.right = xMax;
+        }
+        return words.emplace(std::move(key), m).first->second;
+    }
+
+    LayoutResult wrap(const string& text, int fontHeight, int maxWidth, int lineSpacing) {
+        LayoutResult result;
+        result.lineHeight = atlas.lineHeight(fontHeight);
+        const int spaceAdvance = atlas.glyph(fontHeight, U' ').advance;
+
+        LayoutLine current;
+        int pen = 0, left = 0, right = 0;
+        char32_t lineLast = 0; // Last codepoint of the open line
+        bool lineOpen = false;
+
+        size_t pos = 0;
+        while (pos < text.length()) {
+            while (pos < text.length() && isspace(static_cast<unsigned char>(text[pos]))) pos++;
+            if (pos == text.length()) break;
+            size_t word_start = pos;
+            while (pos < text.length() && !isspace(static_cast<unsigned char>(text[pos]))) pos++;
+            string word = text.substr(word_start, pos - word_start);
+            const WordMetrics& m = measureWord(word, fontHeight);
+
+            if (lineOpen) {
+                // The separating space also counts towards the box, as it does for getTextSize.
+                // The space is kerned against the words on both sides, as in GlyphAtlas::shape.
+                int spacePen = pen + atlas.kerning(fontHeight, lineLast, U' ');
+                int wordPen = spacePen + spaceAdvance + atlas.kerning(fontHeight, U' ', m.first);
+                int candidateLeft = min(left, min(spacePen, wordPen + m.left));
+                int candidateRight = max(right, max(spacePen + spaceAdvance, wordPen + m.right));
+                if (candidateRight - candidateLeft <= maxWidth) {
+                    current.text += " ";
+                    current.text += word;
+                    pen = wordPen + m.advance;
+                    lineLast = m.last;
+                    left = candidateLeft;
+                    right = candidateRight;
+                    continue;
+                }
+                current.width = right - left;
+                result.lines.push_back(std::move(current));
+                current = LayoutLine();
+            }
 
-        Size textSize = ft2->getTextSize(testLine, fontHeight, -1, nullptr);
+            // A word always starts a line, even when it is wider than maxWidth on its own.
+            current.text = word;
+            current.sourceStart = static_cast<int>(word_start);
+            pen = m.advance;
+            lineLast = m.last;
+            left = m.left;
+            right = m.right;
+            lineOpen = true;
+        }
+        if (lineOpen) {
+            current.width = right - left;
+            result.lines.push_back(std::move(current));
+        }
 
-        if (textSize.width <= maxWidth) {
-            currentLineContent = testLine;
-        } else {
-            lines_with_indices.push_back({currentLineContent, currentLineOriginalStartIndex});
-            currentLineContent = nextWord;
-            currentLineOriginalStartIndex = nextWordOriginalIndex;
+        for (size_t i = 0; i < result.lines.size(); ++i) {
+            result.lines[i].baselineOffset = static_cast<int>(i) * (result.lineHeight + lineSpacing) + result.lineHeight;
+        }
+        if (!result.lines.empty()) {
+            result.totalHeight = static_cast<int>(result.lines.size()) * result.lineHeight
+                               + static_cast<int>(result.lines.size() - 1) * lineSpacing;
         }
+        return result;
     }
-    lines_with_indices.push_back({currentLineContent, currentLineOriginalStartIndex});
-    return lines_with_indices;
-}
+
+    GlyphAtlas& atlas;
+    unordered_map<string, LayoutResult> layouts;
+    unordered_map<string, WordMetrics> words;
+};
 
 // Calculates the total height of wrapped text.
-int calculateWrappedTextHeight(Ptr<freetype::FreeType2> ft2, const string& text, int fontHeight, int maxWidth) {
-    vector<string> lines = wrapText(ft2, text, fontHeight, maxWidth);
-    if (lines.empty()) return 0;
-    
-    int singleLineRenderHeight = ft2->getTextSize("Tg", fontHeight, -1, nullptr).height;
-    
-    int totalTextHeight = lines.size() * singleLineRenderHeight;
-    if (lines.size() > 1) {
-        totalTextHeight += (lines.size() - 1) * LINE_SPACING;
-    }
-    return totalTextHeight;
+int calculateWrappedTextHeight(TextLayoutEngine& engine, const string& text, int fontHeight, int maxWidth, int lineSpacing = LINE_SPACING) {
+    return engine.layout(text, fontHeight, maxWidth, lineSpacing).totalHeight;
 }
 
 // Draws wrapped text, centered within the rect, with a vertical offset.
 void drawWrappedText(
     Mat& img,
-    Ptr<freetype::FreeType2> ft2,
+    TextLayoutEngine& engine,
     const string& text,
     const Rect& rect,
     int fontHeight,
     Scalar color,
-    int y_offset = 0) {
+    int y_offset = 0,
+    int lineSpacing = LINE_SPACING) {
     int text_area_width = static_cast<int>(rect.width * 0.95);
-    vector<string> lines = wrapText(ft2, text, fontHeight, text_area_width);
+    const LayoutResult& layout = engine.layout(text, fontHeight, text_area_width, lineSpacing);
 
-    if (lines.empty()) return;
+    if (layout.lines.empty()) return;
 
-    int singleLineRenderHeight = ft2->getTextSize("Tg", fontHeight, -1, nullptr).height;
-    int totalRenderedTextHeight = lines.size() * singleLineRenderHeight;
-    if (lines.size() > 1) {
-        totalRenderedTextHeight += (lines.size() - 1) * LINE_SPACING;
+    int text_block_top = rect.y + (rect.height - layout.totalHeight) / 2 + y_offset;
+    int text_area_start_x = rect.x + (rect.width - text_area_width) / 2;
+
+    for (const LayoutLine& line : layout.lines) {
+        int line_x = text_area_start_x + (text_area_width - line.width) / 2;
+        engine.glyphs().putText(img, line.text, Point(line_x, text_block_top + line.baselineOffset), fontHeight, color);
     }
-    
-    int current_line_y_start = rect.y + (rect.height - totalRenderedTextHeight) / 2 + y_offset;
+}
 
-    for (const string& line : lines) {
-        Size lineSize = ft2->getTextSize(line, fontHeight, -1, nullptr);
+// A glyph placed in frame coordinates, with the bytes of the source text it was drawn from.
+struct PlacedGlyph {
+    const CachedGlyph* glyph;
+    Point pen;
+    size_t sourceStart;
+    size_t sourceEnd;
+};
+
+// Wrapped text laid out once, for drawing the same sentence with different fragments
+// highlighted. Every glyph keeps its pen position and source byte range, so a highlight only
+// redraws the lines it touches, over a box covering the highlighted glyphs.
+// Positions follow drawWrappedText exactly, so the highlighted glyphs land on the pixels of
+// the plain text they replace.
+class HighlightedText {
+public:
+    HighlightedText(TextLayoutEngine& engine, const string& text, const Rect& rect, int fontHeight, int y_offset = 0, int lineSpacing = LINE_SPACING)
+        : text(text) {
+        int text_area_width = static_cast<int>(rect.width * 0.95);
+        const LayoutResult& layout = engine.layout(text, fontHeight, text_area_width, lineSpacing);
+        int text_block_top = rect.y + (rect.height - layout.totalHeight) / 2 + y_offset;
         int text_area_start_x = rect.x + (rect.width - text_area_width) / 2;
-        int line_x = text_area_start_x + (text_area_width - lineSize.width) / 2;
-        int baseline_y = current_line_y_start + singleLineRenderHeight;
-        
-        ft2->putText(img, line, Point(line_x, baseline_y), fontHeight, color, -1, LINE_AA, true);
-        current_line_y_start += singleLineRenderHeight + LINE_SPACING;
+
+        GlyphAtlas& atlas = engine.glyphs();
+        for (const LayoutLine& line : layout.lines) {
+            Point origin(text_area_start_x + (text_area_width - line.width) / 2, text_block_top + line.baselineOffset);
+            const vector<ShapedGlyph>& shaped = atlas.shape(line.text, fontHeight).glyphs;
+            vector<PlacedGlyph> placed;
+            for (size_t g = 0; g < shaped.size(); ++g) {
+                size_t clusterEnd = g + 1 < shaped.size() ? shaped[g + 1].cluster : line.text.size();
+                placed.push_back({shaped[g].glyph, Point(origin.x + shaped[g].x, origin.y),
+                                  line.sourceStart + shaped[g].cluster, line.sourceStart + clusterEnd});
+            }
+            lines.push_back(std::move(placed));
+        }
     }
+
+    // Draws the whole text in one colour, the same pixels drawWrappedText produces.
+    void draw(Mat& img, const Scalar& color) const {
+        for (const vector<PlacedGlyph>& line : lines) {
+            for (const PlacedGlyph& p : line) GlyphAtlas::blitGlyph(img, *p.glyph, p.pen, color);
+        }
+    }
+
+    // Recolours the first occurrence of fragment in img, which must already hold the text
+    // drawn in defaultColor over plate. On every line the fragment touches, the box around
+    // its glyphs is restored from plate and each glyph reaching into the box is redrawn
+    // clipped to it, so pixels outside the box are never blended twice.
+    void highlight(Mat& img, const Mat& plate, const string& fragment,
+                   const Scalar& defaultColor, const Scalar& highlightColor) const {
+        size_t start = text.find(fragment);
+        if (start == string::npos || fragment.empty()) return;
+        size_t end = start + fragment.size();
+
+        const Rect frame(0, 0, img.cols, img.rows);
+        for (const vector<PlacedGlyph>& line : lines) {
+            Rect box;
+            for (const PlacedGlyph& p : line) {
+                if (p.sourceEnd > start && p.sourceStart < end) box |= glyphBox(p);
+            }
+            box &= frame;
+            if (box.area() == 0) continue;
+
+            // Neighbouring lines are checked too, in case a descender reaches into the box.
+            Mat roi = img(box);
+            plate(box).copyTo(roi);
+            for (const vector<PlacedGlyph>& other : lines) {
+                for (const PlacedGlyph& p : other) {
+                    if ((glyphBox(p) & box).area() == 0) continue;
+                    bool highlighted = p.sourceEnd > start && p.sourceStart < end;
+                    GlyphAtlas::blitGlyph(roi, *p.glyph, p.pen - box.tl(), highlighted ? highlightColor : defaultColor);
+                }
+            }
+        }
+    }
+
+private:
+    static Rect glyphBox(const PlacedGlyph& p) {
+        const CachedGlyph& g = *p.glyph;
+        return Rect(p.pen + g.offset, g.coverage.size());
+    }
+
+    string text;
+    vector<vector<PlacedGlyph>> lines;
+};
+
+// 64-bit content hash of an image: dimensions, type and every pixel byte.
+// Four independent lanes keep the multiplies pipelined on 1080p frames.
+uint64_t hashFrame(const Mat& img) {
+    const uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+    uint64_t lanes[4] = {PRIME_1, PRIME_2, PRIME_1 ^ PRIME_2, PRIME_1 + PRIME_2};
+    auto mix = [&](uint64_t lane, uint64_t word) {
+        lane ^= word * PRIME_2;
+        lane = (lane << 31) | (lane >> 33);
+        return lane * PRIME_1;
+    };
+
+    const size_t row_bytes = static_cast<size_t>(img.cols) * img.elemSize();
+    for (int y = 0; y < img.rows; ++y) {
+        const uchar* row = img.ptr<uchar>(y);
+        size_t i = 0;
+        for (; i + 32 <= row_bytes; i += 32) {
+            uint64_t w[4];
+            memcpy(w, row + i, 32);
+            lanes[0] = mix(lanes[0], w[0]);
+            lanes[1] = mix(lanes[1], w[1]);
+            lanes[2] = mix(lanes[2], w[2]);
+            lanes[3] = mix(lanes[3], w[3]);
+        }
+        for (; i < row_bytes; ++i) {
+            lanes[i & 3] = mix(lanes[i & 3], row[i]);
+        }
+    }
+
+    uint64_t h = static_cast<uint64_t>(img.rows) * PRIME_1 ^ static_cast<uint64_t>(img.cols) * PRIME_2 ^ static_cast<uint64_t>(img.type());
+    for (uint64_t lane : lanes) {
+        h = mix(h, lane);
+    }
+    h ^= h >> 33; h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33; h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
 }
 
-// Draws wrapped text with a highlighted fragment.
-void drawWrappedTextWithHighlight(
-    Mat& img,
-    Ptr<freetype::FreeType2> ft2,
-    const string& fullText,
-    const string& highlightText,
-    const Rect& rect,
-    int fontHeight,
-    Scalar defaultColor,
-    Scalar highlightColor,
-    int y_offset = 0) {
-    int text_area_width = static_cast<int>(rect.width * 0.95);
-    vector<pair<string, int>> lines_with_indices = wrapTextAndOriginalIndices(ft2, fullText, fontHeight, text_area_width);
+// Full frame from a background and the band drawn over its bottom rows.
+Mat composeFrame(const Mat& background, const Mat& band) {
+    const int bandTop = background.rows - band.rows;
+    Mat frame = framePool.acquire(background.rows, background.cols, background.type());
+    background.rowRange(0, bandTop).copyTo(frame.rowRange(0, bandTop));
+    band.copyTo(frame.rowRange(bandTop, background.rows));
+    return frame;
+}
+
+// Full frame in I420 layout (Y plane, then the U and V planes at half width and height, as
+// cvtColor's COLOR_BGR2YUV_I420 writes them) from the background already converted to I420
+// and the BGR band drawn over its bottom rows. Only the band is converted; everything above it
+// is copied plane by plane from the converted background. The band must start on an even row
+// so that it covers whole chroma rows.
+Mat composeYuvFrame(const Mat& yuvBackground, const Mat& band) {
+    const int width = band.cols;
+    const int height = yuvBackground.rows * 2 / 3;
+    const int bandTop = height - band.rows;
+    CV_Assert(bandTop % 2 == 0 && yuvBackground.isContinuous());
+
+    // Not pooled: its height follows the phrase's panel, so pooled bands would pile up one
+    // shape per panel height.
+    Mat yuvBand;
+    cvtColor(band, yuvBand, COLOR_BGR2YUV_I420);
+
+    Mat frame = framePool.acquire(yuvBackground.rows, width, CV_8UC1);
+    const size_t lumaSize = static_cast<size_t>(height) * width;
+    const size_t lumaAbove = static_cast<size_t>(bandTop) * width;
+    const size_t lumaBand = lumaSize - lumaAbove;
+    size_t frameOffset = 0, bandOffset = 0;
+    for (int plane = 0; plane < 3; ++plane) {
+        const size_t divisor = plane == 0 ? 1 : 4; // Chroma planes hold a quarter of the samples
+        memcpy(frame.data + frameOffset, yuvBackground.data + frameOffset, lumaAbove / divisor);
+        memcpy(frame.data + frameOffset + lumaAbove / divisor, yuvBand.data + bandOffset, lumaBand / divisor);
+        frameOffset += lumaSize / divisor;
+        bandOffset += lumaBand / divisor;
+    }
+    return frame;
+}
+
+// --rotulos: writes chosen frames a second time with a label on top, to paths of their own
+// (Imagenes_English/<frame>.<ext> and Imagenes_Spanish/<frame>.<ext>). The frame store hands
+// every frame to store() while it is still in memory, so a labelled frame costs one composite
+// and one encode instead of image_preprocessor.cpp decoding the stored frame again.
+// It is also a frame sink of its own: renderPhrase() with this sink only emits the labelled
+// frames, for --incremental phrases whose other frames are already on disk.
+// Frames are added before rendering starts and only looked up afterwards.
+class LabelledFrameWriter {
+public:
+    explicit LabelledFrameWriter(AsyncFrameWriter& writer) : writer(writer) {}
+
+    void add(int frameNumber, const string& path, const LabelSprite& label) {
+        frames[frameNumber] = {path, &label};
+    }
 
-    if (lines_with_indices.empty()) return;
+    bool tileMode() const { return false; }
+    int tileY() const { return -1; }
+    bool needs(int frameNumber) const { return frames.count(frameNumber) > 0; }
 
-    int singleLineRenderHeight = ft2->getTextSize("Tg", fontHeight, -1, nullptr).height;
-    int totalRenderedTextHeight = lines_with_indices.size() * singleLineRenderHeight;
-    if (lines_with_indices.size() > 1) {
-        totalRenderedTextHeight += (lines_with_indices.size() - 1) * LINE_SPACING;
+    void store(int frameNumber, const Mat& background, const Mat& band, int) {
+        auto it = frames.find(frameNumber);
+        if (it == frames.end()) return;
+        Mat frame = composeFrame(background, band);
+        compositeSprite(frame, *it->second.label);
+        writer.write(it->second.path, frame);
     }
 
-    int current_line_y_start = rect.y + (rect.height - totalRenderedTextHeight) / 2 + y_offset;
+private:
+    struct LabelledFrame {
+        string path;
+        const LabelSprite* label;
+    };
+
+    AsyncFrameWriter& writer;
+    map<int, LabelledFrame> frames;
+};
+
+// Content-addressed store for rendered frames. Each distinct image is encoded once as
+// <hash>.<ext> in the output directory; every frame number is recorded in a manifest
+// (frame|file|hash per line) that image_preprocessor.cpp and generar_videos.cpp read
+// to find the file behind a frame number.
+// Safe to share between render threads: file names depend only on content and the manifest
+// is ordered by frame number, so the output does not depend on which thread stored what first.
+//
+// In tile mode (tileTop >= 0) a frame is split into its character background, written
+// once per background, and an RGBA tile covering rows tileTop to the bottom in which the
+// rows above the panel are transparent. The video assembler overlays the tile at
+// (0, tileTop); manifest lines then carry the background file as a fourth field.
+//
+// With --rotulos the labelled variants of some frames are written alongside (see
+// LabelledFrameWriter) and the manifest starts with a "#rotulos|1" line.
+class FrameStore {
+public:
+    FrameStore(const string& outputDir, AsyncFrameWriter& writer, int tileTop = -1)
+        : outputDir(outputDir), writer(writer), tileTop(tileTop) {}
+
+    bool tileMode() const { return tileTop >= 0; }
+    int tileY() const { return tileTop; }
+    bool needs(int) const { return true; } // Every frame goes to disk
+
+    // --rotulos: frames are also passed on to `labels` before they are stored.
+    void setLabelledFrames(LabelledFrameWriter* labelledFrames) { labels = labelledFrames; }
+
+    // --incremental: the output directory keeps the files of the last run, so a frame whose
+    // content-addressed file is already there is not encoded again, even if no manifest entry
+    // of that run referred to it.
+    void setReuseFilesOnDisk(bool reuse) { reuseFilesOnDisk = reuse; }
+
+    // Stores one frame given as the background plus the band of its bottom rows that was
+    // drawn on (band rows map to the last band.rows rows of the background). panelTop
+    // is the first band row, in frame coordinates, that differs from the background. The
+    // stored image is a copy, so the band may be drawn on afterwards.
+    void store(int frameNumber, const Mat& background, const Mat& band, int panelTop) {
+        const int bandTop = background.rows - band.rows;
+        if (labels) labels->store(frameNumber, background, band, panelTop);
+        if (!tileMode()) {
+            storeImage(frameNumber, composeFrame(background, band), "");
+            return;
+        }
+
+        CV_Assert(bandTop == tileTop);
+        Mat tile = framePool.acquire(band.rows, band.cols, CV_8UC4);
+        cvtColor(band, tile, COLOR_BGR2BGRA);
+        // Clearing the rows above the panel also makes tiles independent of the background,
+        // so identical panels over different characters share one file.
+        tile.rowRange(0, max(0, min(tile.rows, panelTop - tileTop))).setTo(Scalar::all(0));
+        storeImage(frameNumber, tile, backgroundFile(background));
+    }
 
-    size_t highlight_start_in_fullText = fullText.find(highlightText);
-    size_t highlight_end_in_fullText = (highlight_start_in_fullText == string::npos) ? 0 : highlight_start_in_fullText + highlightText.length();
+    struct ManifestEntry {
+        string file;
+        uint64_t hash = 0;
+        string background; // Tile mode only
+    };
+
+    // Reads the manifest of an earlier run. Returns false if there is none.
+    static bool readManifest(const string& outputDir, map<int, ManifestEntry>& entries) {
+        ifstream manifest(outputDir + "/" + ARCHIVO_MANIFIESTO);
+        if (!manifest.is_open()) return false;
+        string line;
+        while (getline(manifest, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            vector<string> fields;
+            stringstream ss(line);
+            string field;
+            while (getline(ss, field, '|')) fields.push_back(field);
+            if (fields.size() < 3) continue;
+            try {
+                ManifestEntry entry{fields[1], stoull(fields[2], nullptr, 16), fields.size() > 3 ? fields[3] : ""};
+                entries[stoi(fields[0])] = entry;
+            } catch (const exception&) {
+                return false;
+            }
+        }
+        return true;
+    }
 
-    if (highlight_start_in_fullText == string::npos) {
-        drawWrappedText(img, ft2, fullText, rect, fontHeight, defaultColor, y_offset);
-        return;
+    // True if the files behind a manifest entry of an earlier run are still on disk.
+    bool onDisk(const ManifestEntry& entry) const {
+        return fs::exists(outputDir + "/" + entry.file)
+            && (entry.background.empty() || fs::exists(outputDir + "/" + entry.background));
     }
 
-    int text_area_start_x = rect.x + (rect.width - text_area_width) / 2;
+    // Records a frame whose file an earlier run already wrote (--incremental).
+    void adopt(int frameNumber, const ManifestEntry& entry) {
+        lock_guard<mutex> lock(mtx);
+        filesByHash.emplace(entry.hash, entry.file);
+        if (!entry.background.empty()) {
+            // Background files are named after their hash, so later tiles find them again.
+            try {
+                filesByHash.emplace(stoull(entry.background.substr(0, 16), nullptr, 16), entry.background);
+            } catch (const exception&) {}
+        }
+        frames[frameNumber] = entry;
+    }
 
-    for (const auto& line_pair : lines_with_indices) {
-        const string& line_content = line_pair.first;
-        int line_original_start_index = line_pair.second;
+    // Deletes the files in the output directory that no frame refers to any more, such as the
+    // frames of phrases that changed since the last run. Returns how many were deleted.
+    size_t removeUnreferencedFiles() const {
+        set<string> keep = {ARCHIVO_MANIFIESTO, ARCHIVO_CACHE_FRASES};
+        {
+            lock_guard<mutex> lock(mtx);
+            for (const auto& file : filesByHash) keep.insert(file.second);
+        }
+        size_t removed = 0;
+        for (const auto& entry : fs::directory_iterator(outputDir)) {
+            if (entry.is_regular_file() && !keep.count(entry.path().filename().string())) {
+                error_code ec;
+                if (fs::remove(entry.path(), ec)) removed++;
+            }
+        }
+        return removed;
+    }
 
-        Size lineSize = ft2->getTextSize(line_content, fontHeight, -1, nullptr);
-        int line_x_initial = text_area_start_x + (text_area_width - lineSize.width) / 2;
-        int baseline_y = current_line_y_start + singleLineRenderHeight;
+    bool hasFrame(int frameNumber) const { lock_guard<mutex> lock(mtx); return frames.count(frameNumber) > 0; }
+    size_t totalFrames() const { lock_guard<mutex> lock(mtx); return frames.size(); }
+    size_t uniqueFrames() const { lock_guard<mutex> lock(mtx); return filesByHash.size(); }
 
-        int current_draw_x = line_x_initial;
-        int current_char_in_line_index = 0;
+    bool writeManifest() const {
+        lock_guard<mutex> lock(mtx);
+        ofstream manifest(outputDir + "/" + ARCHIVO_MANIFIESTO, ios::trunc);
+        if (!manifest.is_open()) return false;
+        if (tileMode()) {
+            manifest << "#teselas|" << tileTop << "\n";
+        }
+        if (labels) {
+            manifest << "#rotulos|1\n";
+        }
+        for (const auto& frame : frames) {
+            const ManifestEntry& entry = frame.second;
+            manifest << frame.first << "|" << entry.file << "|" << hashToHex(entry.hash);
+            if (!entry.background.empty()) manifest << "|" << entry.background;
+            manifest << "\n";
+        }
+        return manifest.good();
+    }
 
-        while (current_char_in_line_index < line_content.length()) {
-            int char_original_index_in_fullText = line_original_start_index + current_char_in_line_index;
-            bool is_highlighted_segment = (char_original_index_in_fullText >= highlight_start_in_fullText && char_original_index_in_fullText < highlight_end_in_fullText);
+    static string hashToHex(uint64_t hash) {
+        stringstream ss;
+        ss << hex << setw(16) << setfill('0') << hash;
+        return ss.str();
+    }
 
-            int segment_end_in_line_index = current_char_in_line_index;
-            while (segment_end_in_line_index < line_content.length()) {
-                int next_char_original_index_in_fullText = line_original_start_index + segment_end_in_line_index;
-                bool next_is_highlighted_segment = (next_char_original_index_in_fullText >= highlight_start_in_fullText && next_char_original_index_in_fullText < highlight_end_in_fullText);
-                if (is_highlighted_segment != next_is_highlighted_segment) break;
-                segment_end_in_line_index++;
+private:
+    // Writes img under its content hash unless an identical image was already stored.
+    string storeImage(int frameNumber, const Mat& img, const string& background) {
+        uint64_t hash = hashFrame(img);
+        string file = hashToHex(hash) + writer.extension();
+        string path = outputDir + "/" + file;
+        bool firstOccurrence;
+        {
+            lock_guard<mutex> lock(mtx);
+            firstOccurrence = filesByHash.emplace(hash, file).second;
+            if (frameNumber > 0) frames[frameNumber] = {file, hash, background};
+        }
+        if (firstOccurrence && !(reuseFilesOnDisk && fs::exists(path))) {
+            writer.write(path, img);
+        } else if (frameNumber > 0) {
+            logLine("♻️  Frame " + to_string(frameNumber) + " reutiliza: " + path);
+        }
+        return file;
+    }
+
+    // File holding a character background. Backgrounds come from the BackgroundCache, whose
+    // images live for the whole run, so the pixel pointer identifies them without rehashing.
+    string backgroundFile(const Mat& background) {
+        {
+            lock_guard<mutex> lock(mtx);
+            auto it = backgroundFiles.find(background.data);
+            if (it != backgroundFiles.end()) return it->second;
+        }
+        string file = storeImage(0, background, "");
+        lock_guard<mutex> lock(mtx);
+        backgroundFiles.emplace(background.data, file);
+        return file;
+    }
+
+    string outputDir;
+    AsyncFrameWriter& writer;
+    int tileTop;
+    LabelledFrameWriter* labels = nullptr;
+    bool reuseFilesOnDisk = false;
+    mutable mutex mtx;
+    unordered_map<uint64_t, string> filesByHash;
+    unordered_map<const uchar*, string> backgroundFiles;
+    map<int, ManifestEntry> frames; // frame number -> file
+};
+
+// Frames shared by several videos of one --stream run, kept LZ4-compressed in memory so that
+// later videos take them from here instead of rendering them again. Once the compressed frames
+// exceed `budgetBytes`, further frames are spilled as .lz4 files to a temporary directory of
+// this process, which is removed with the cache. Safe to share between render threads: workers compress
+// outside the lock and every frame is stored once.
+class CompressedFrameCache {
+public:
+    explicit CompressedFrameCache(size_t budgetBytes)
+        : budgetBytes(budgetBytes) {}
+
+    ~CompressedFrameCache() {
+        error_code ec;
+        if (!spillDir.empty()) fs::remove_all(spillDir, ec);
+    }
+
+    bool has(int frameNumber) const {
+        lock_guard<mutex> lock(mtx);
+        return frames.count(frameNumber) > 0;
+    }
+
+    // Compresses and keeps a copy of the frame. Frames already cached are left alone.
+    void put(int frameNumber, const Mat& frame) {
+        if (has(frameNumber)) return;
+        CV_Assert(frame.isContinuous());
+        const int rawBytes = static_cast<int>(frame.total() * frame.elemSize());
+        vector<char> compressed(LZ4_compressBound(rawBytes));
+        const int size = LZ4_compress_default(reinterpret_cast<const char*>(frame.data), compressed.data(), rawBytes, static_cast<int>(compressed.size()));
+        if (size <= 0) return; // Not cached; later videos render it again
+        compressed.resize(size);
+
+        lock_guard<mutex> lock(mtx);
+        if (frames.count(frameNumber)) return;
+        Entry entry;
+        entry.rows = frame.rows;
+        entry.cols = frame.cols;
+        entry.type = frame.type();
+        entry.compressedBytes = size;
+        rawTotal += rawBytes;
+        compressedTotal += size;
+        if (memoryBytes + size <= budgetBytes) {
+            memoryBytes += size;
+            peakMemoryBytes = max(peakMemoryBytes, memoryBytes);
+            entry.data = std::move(compressed);
+        } else {
+            // Over budget: the file is written under the lock so that get() never sees it half written
+            if (spillDir.empty() && (spillUnavailable || !createSpillDirectory())) return; // Not cached; later videos render it again
+            entry.spillPath = spillDir + "/" + to_string(frameNumber) + ".lz4";
+            ofstream out(entry.spillPath, ios::binary);
+            out.write(compressed.data(), size);
+            if (!out) return;
+            spilled++;
+        }
+        frames.emplace(frameNumber, std::move(entry));
+    }
+
+    // Decompresses a cached frame into a pooled buffer. Returns an empty Mat if it is missing.
+    Mat get(int frameNumber) const {
+        const Entry* entry;
+        {
+            lock_guard<mutex> lock(mtx);
+            auto it = frames.find(frameNumber);
+            if (it == frames.end()) return Mat();
+            entry = &it->second; // Entries are never modified once stored
+        }
+        vector<char> fromDisk;
+        const char* source = entry->data.data();
+        if (!entry->spillPath.empty()) {
+            fromDisk.resize(entry->compressedBytes);
+            ifstream in(entry->spillPath, ios::binary);
+            if (!in.read(fromDisk.data(), entry->compressedBytes)) return Mat();
+            source = fromDisk.data();
+        }
+        Mat frame = framePool.acquire(entry->rows, entry->cols, entry->type);
+        const int rawBytes = static_cast<int>(frame.total() * frame.elemSize());
+        if (LZ4_decompress_safe(source, reinterpret_cast<char*>(frame.data), entry->compressedBytes, rawBytes) != rawBytes) return Mat();
+        return frame;
+    }
+
+    // Frees the frames no later video needs. Must not run while frames are being read.
+    void keepOnly(const set<int>& keep) {
+        lock_guard<mutex> lock(mtx);
+        for (auto it = frames.begin(); it != frames.end();) {
+            if (keep.count(it->first)) {
+                ++it;
+                continue;
+            }
+            if (it->second.spillPath.empty()) {
+                memoryBytes -= it->second.compressedBytes;
+            } else {
+                error_code ec;
+                fs::remove(it->second.spillPath, ec);
+            }
+            it = frames.erase(it);
+        }
+    }
+
+    // Prints how many frames went through the cache and how well they compressed.
+    void report() const {
+        lock_guard<mutex> lock(mtx);
+        if (rawTotal == 0) return;
+        cout << "   Cache de frames: hasta " << fixed << setprecision(1) << peakMemoryBytes / (1024.0 * 1024.0) << " MB en memoria, "
+             << "compresion " << (double)rawTotal / max<size_t>(1, compressedTotal) << defaultfloat << ":1, "
+             << spilled << " frame(s) en disco." << endl;
+    }
+
+private:
+    struct Entry {
+        int rows = 0, cols = 0, type = 0;
+        int compressedBytes = 0;
+        vector<char> data; // Empty when spilled
+        string spillPath;
+    };
+
+    // Creates this process's spill directory, named after the PID and a random suffix so that
+    // concurrent runs never share (or delete) each other's files. Called under the lock.
+    bool createSpillDirectory() {
+        random_device seed;
+        mt19937_64 random(seed() ^ static_cast<uint64_t>(chrono::steady_clock::now().time_since_epoch().count()));
+        error_code ec;
+        const fs::path base = fs::temp_directory_path(ec);
+        if (ec) return false;
+        for (int attempt = 0; attempt < 8; ++attempt) {
+            stringstream name;
+            name << "imagenes_cache_frames_" << _getpid() << "_" << hex << random();
+            const fs::path dir = base / name.str();
+            if (fs::create_directory(dir, ec)) {
+                spillDir = dir.string();
+                return true;
+            }
+            if (ec) break; // Not a name clash: the temporary directory is not writable
+        }
+        cerr << "Advertencia: No se pudo crear la carpeta temporal de la cache de frames; los frames que no caben en memoria se renderizaran de nuevo." << endl;
+        spillUnavailable = true;
+        return false;
+    }
+
+    size_t budgetBytes;
+    string spillDir; // Empty until the first frame is spilled
+    bool spillUnavailable = false;
+    mutable mutex mtx;
+    map<int, Entry> frames;
+    size_t memoryBytes = 0;
+    size_t peakMemoryBytes = 0;
+    size_t rawTotal = 0;        // Bytes of every frame put, before and after compression
+    size_t compressedTotal = 0;
+    size_t spilled = 0;
+};
+
+// Streams frames straight into the video encoder (imagenes.exe --stream) instead of writing
+// image files. Rendered frames wait in memory until the pipe writer reaches them, and each is
+// sent as raw BGR video frames for as long as its audio block lasts. Only frames that are not
+// next in line count against `capacity`, so workers that run ahead block while the frame the
+// writer waits for can always be handed over.
+//
+// With `yuv` (--yuv) frames are kept and sent in the encoder's own 4:2:0 format as a y4m
+// stream: each background is converted to I420 once, and per frame only the band is, so
+// ffmpeg no longer converts every full BGR frame before encoding.
+//
+// When one run streams several videos, frames already in `cache` are sent from there instead
+// of being rendered, and the frames in `keep` (needed by later videos) are added to it.
+class FrameStreamer {
+public:
+    struct Entry {
+        int frame = 0;
+        double duration = 0; // Seconds on screen
+    };
+
+    FrameStreamer(vector<Entry> entries, size_t capacity, bool yuv = false,
+                  CompressedFrameCache* cache = nullptr, set<int> keep = set<int>())
+        : entries(std::move(entries)), capacity(max<size_t>(1, capacity)), yuv(yuv), cache(cache), keep(std::move(keep)) {
+        nextFrame = INT_MAX;
+        for (const Entry& entry : this->entries) {
+            if (cache && cache->has(entry.frame)) continue;
+            if (nextFrame == INT_MAX) nextFrame = entry.frame;
+            remainingUses[entry.frame]++;
+        }
+        for (const auto& use : remainingUses) {
+            wanted.insert(use.first);
+        }
+    }
+
+    bool tileMode() const { return false; }
+    int tileY() const { return -1; }
+    bool needs(int frameNumber) const { return wanted.count(frameNumber) > 0 || keep.count(frameNumber) > 0; }
+
+    // Frames of this video that have to be rendered; the rest come from the cache.
+    const set<int>& renderedFrames() const { return wanted; }
+
+    void store(int frameNumber, const Mat& background, const Mat& band, int) {
+        if (!needs(frameNumber)) return;
+        Mat frame = yuv ? composeYuvFrame(yuvBackground(background), band) : composeFrame(background, band);
+        if (cache && keep.count(frameNumber)) cache->put(frameNumber, frame);
+        if (!wanted.count(frameNumber)) return;
+        unique_lock<mutex> lock(mtx);
+        notFull.wait(lock, [&]() { return pending.size() < capacity || frameNumber <= nextFrame || aborted; });
+        if (aborted) return;
+        pending.emplace(frameNumber, std::move(frame));
+        frameReady.notify_all();
+    }
+
+    // Stops the writer and releases blocked workers; used when rendering fails.
+    void abort() {
+        lock_guard<mutex> lock(mtx);
+        aborted = true;
+        frameReady.notify_all();
+        notFull.notify_all();
+    }
+
+    // Called when the last worker is done: no more frames will be stored, so the writer stops
+    // waiting for frames that have not arrived yet.
+    void renderingFinished() {
+        lock_guard<mutex> lock(mtx);
+        finished = true;
+        frameReady.notify_all();
+    }
+
+    // Writes every entry to `pipe` at `fps` frames per second. Frame counts follow the
+    // cumulative time, so rounding never drifts from the audio. Returns false if a frame
+    // never arrived or the pipe failed.
+    bool writeAll(FILE* pipe, int fps) {
+        static const char yuvFrameHeader[] = "FRAME\n";
+        bool headerWritten = false;
+        long long framesWritten = 0;
+        double elapsed = 0;
+        for (const Entry& entry : entries) {
+            Mat frame;
+            if (!wanted.count(entry.frame)) {
+                frame = cache->get(entry.frame);
+                if (frame.empty()) {
+                    abort();
+                    return false;
+                }
+            } else {
+                unique_lock<mutex> lock(mtx);
+                nextFrame = entry.frame;
+                notFull.notify_all();
+                frameReady.wait(lock, [&]() { return pending.count(entry.frame) > 0 || aborted || finished; });
+                auto it = pending.find(entry.frame);
+                if (it == pending.end()) {
+                    if (!aborted) {
+                        logLine("Error: Ninguna frase renderizo el frame " + to_string(entry.frame) + " del video.");
+                    }
+                    return false;
+                }
+                frame = it->second;
+                if (--remainingUses[entry.frame] == 0) {
+                    pending.erase(it);
+                    notFull.notify_all();
+                }
+            }
+
+            CV_Assert(frame.isContinuous());
+            const size_t frameBytes = frame.total() * frame.elemSize();
+            if (yuv && !headerWritten) {
+                // Chroma samples are 2x2 averages, centred like JPEG's; levels are video range
+                string header = "YUV4MPEG2 W" + to_string(frame.cols) + " H" + to_string(frame.rows * 2 / 3) + " F" + to_string(fps)
+                                + ":1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n";
+                if (fwrite(header.data(), 1, header.size(), pipe) != header.size()) {
+                    abort();
+                    return false;
+                }
+                headerWritten = true;
+            }
+            elapsed += entry.duration;
+            const long long target = llround(elapsed * fps);
+            for (; framesWritten < target; ++framesWritten) {
+                if (yuv && fwrite(yuvFrameHeader, 1, sizeof(yuvFrameHeader) - 1, pipe) != sizeof(yuvFrameHeader) - 1) {
+                    abort();
+                    return false;
+                }
+                if (fwrite(frame.data, 1, frameBytes, pipe) != frameBytes) {
+                    abort();
+                    return false;
+                }
             }
+        }
+        return true;
+    }
 
-            string segment_to_draw = line_content.substr(current_char_in_line_index, segment_end_in_line_index - current_char_in_line_index);
-            Scalar drawColor = is_highlighted_segment ? highlightColor : defaultColor;
+private:
+    // The background converted to I420, done by the first worker that streams a frame over it.
+    // Backgrounds live in the BackgroundCache for the whole run, so their pixels identify them.
+    const Mat& yuvBackground(const Mat& background) {
+        {
+            lock_guard<mutex> lock(yuvMtx);
+            auto it = yuvBackgrounds.find(background.data);
+            if (it != yuvBackgrounds.end()) return it->second;
+        }
+        Mat converted;
+        cvtColor(background, converted, COLOR_BGR2YUV_I420);
+        lock_guard<mutex> lock(yuvMtx);
+        return yuvBackgrounds.emplace(background.data, std::move(converted)).first->second;
+    }
+
+    vector<Entry> entries;
+    size_t capacity;
+    bool yuv;
+    CompressedFrameCache* cache;
+    set<int> keep;
+    mutex yuvMtx;
+    unordered_map<const uchar*, Mat> yuvBackgrounds;
+    set<int> wanted;
+    map<int, int> remainingUses; // Writer thread only
+    mutex mtx;
+    condition_variable notFull;
+    condition_variable frameReady;
+    map<int, Mat> pending;
+    int nextFrame;
+    bool aborted = false;
+    bool finished = false; // Every worker has exited
+};
+
+// One row of Excel.txt together with the frame numbers it occupies. Frame numbers are
+// assigned up front with a prefix sum, so phrases can be rendered in any order.
+struct PhraseJob {
+    int index = 0;
+    string frase_en;
+    string frase_es;
+    vector<pair<string, string>> subfrases;
+    string background_path;
+    int first_frame = 0;
+
+    // img1, img2, img3, two frames per subphrase and the final frame twice
+    int frameCount() const { return 5 + 2 * static_cast<int>(subfrases.size()); }
+    int englishOnlyFrame() const { return first_frame + 1; }
+    int englishSpanishFrame() const { return first_frame + 2; }
+};
+
+// Rendering state owned by a single worker thread: FreeType is not thread-safe, so every
+// worker gets its own face along with its own glyph atlas and layout cache.
+struct RenderContext {
+    Ptr<freetype::FreeType2> ft2;
+    GlyphAtlas atlas;
+    TextLayoutEngine layoutEngine;
+
+    explicit RenderContext(Ptr<freetype::FreeType2> ft2) : ft2(ft2), atlas(ft2, FUENTE), layoutEngine(atlas) {}
+};
+
+// Blends the panel colour over the rect at RECTANGLE_OPACITY.
+void applySemiTransparentRect(Mat& targetImage, const Rect& rectToOverlay) {
+    if (rectToOverlay.width <= 0 || rectToOverlay.height <= 0) return;
+    Mat roi = targetImage(rectToOverlay);
+    blendConstantColor(roi, COLOR_RECTANGULO_NUEVO, RECTANGLE_OPACITY);
+}
+
+// Subtitle label for frames of the given size as a premultiplied sprite, drawn once per run.
+LabelSprite buildSubtitleLabel(Ptr<freetype::FreeType2> ft2, const string& text, int baseFontHeight, Size size) {
+    return cropLabelSprite(renderLabelBgra(size, [&](Mat& img) { drawSubtitleLabel(img, ft2, text, baseFontHeight); }));
+}
+
+// --benchmark-mezcla: times the old addWeighted overlay against blendConstantColor on a
+// panel-sized region and reports the largest per-channel difference between them.
+void runBlendBenchmark() {
+    const Size panel(IMG_WIDTH, 500);
+    const int iterations = 200;
+    Mat source(panel, CV_8UC3);
+    randu(source, Scalar::all(0), Scalar::all(256));
+
+    Mat reference = source.clone();
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        source.copyTo(reference);
+        Mat coloredOverlay(reference.size(), reference.type(), COLOR_RECTANGULO_NUEVO);
+        addWeighted(coloredOverlay, RECTANGLE_OPACITY, reference, 1.0 - RECTANGLE_OPACITY, 0.0, reference);
+    }
+    double addWeightedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    Mat blended = source.clone();
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        source.copyTo(blended);
+        blendConstantColor(blended, COLOR_RECTANGULO_NUEVO, RECTANGLE_OPACITY);
+    }
+    double kernelMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    Mat copyOnly = source.clone();
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        source.copyTo(copyOnly);
+    }
+    double copyMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    Mat difference;
+    absdiff(reference, blended, difference);
+    double maxDifference = 0;
+    minMaxLoc(difference.reshape(1), nullptr, &maxDifference);
+
+    const char* path =
+#if defined(__AVX2__)
+        "AVX2";
+#elif defined(__SSE2__) || defined(_M_X64)
+        "SSE2";
+#else
+        "escalar";
+#endif
+    double perAddWeighted = (addWeightedMs - copyMs) / iterations;
+    double perKernel = (kernelMs - copyMs) / iterations;
+    cout << fixed << setprecision(3);
+    cout << "Mezcla de " << panel.width << "x" << panel.height << " (" << iterations << " iteraciones, ruta " << path << "):" << endl;
+    cout << "  addWeighted:        " << perAddWeighted << " ms por rectangulo" << endl;
+    cout << "  blendConstantColor: " << perKernel << " ms por rectangulo" << endl;
+    if (perKernel > 0) {
+        cout << "  Aceleracion: x" << setprecision(2) << perAddWeighted / perKernel << endl;
+    }
+    cout << "  Diferencia maxima por canal: " << static_cast<int>(maxDifference) << endl;
+}
+
+// --verificar-atlas: draws strings with kerned pairs through the glyph atlas and through
+// FreeType2::putText at the panel's font sizes and compares the boxes and the pixels.
+// Returns false if any run differs.
+bool runAtlasCheck(Ptr<freetype::FreeType2> ft2) {
+    GlyphAtlas atlas(ft2, FUENTE);
+    const vector<string> samples = {"AVATAR", "To You, Yes", "Wave Tomorrow, Year", "LT Ty P. F. V. W."};
+    bool allMatch = true;
+    for (int fontHeight : {FONT_HEIGHT_EN, FONT_HEIGHT_ES, FONT_HEIGHT_FRAGMENTO_ES}) {
+        for (const string& text : samples) {
+            const Size expectedSize = ft2->getTextSize(text, fontHeight, -1, nullptr);
+            const Size atlasSize = atlas.getTextSize(text, fontHeight);
+            const Point origin(fontHeight, 2 * fontHeight);
+            const Size canvas(expectedSize.width + 2 * fontHeight, 3 * fontHeight);
+            Mat reference(canvas, CV_8UC3, Scalar::all(0));
+            Mat drawn(canvas, CV_8UC3, Scalar::all(0));
+            ft2->putText(reference, text, origin, fontHeight, Scalar::all(255), -1, LINE_AA, true);
+            atlas.putText(drawn, text, origin, fontHeight, Scalar::all(255));
+
+            Mat difference;
+            absdiff(reference, drawn, difference);
+            double maxDifference = 0;
+            minMaxLoc(difference.reshape(1), nullptr, &maxDifference);
+            const bool match = atlasSize == expectedSize && maxDifference <= 1;
+            allMatch = allMatch && match;
+            cout << (match ? "  OK    " : "  FALLO ") << fontHeight << " px \"" << text << "\": ancho " << atlasSize.width
+                 << " (putText " << expectedSize.width << "), diferencia maxima " << static_cast<int>(maxDifference) << endl;
+        }
+    }
+    cout << (allMatch ? "El atlas dibuja igual que putText." : "El atlas no coincide con putText.") << endl;
+    return allMatch;
+}
+
+// An output canvas (--lienzos) and the panel metrics at its size. The constants above are
+// for 1080 lines; other canvases scale them by min(width, height) / 1080, so a 1080x1920
+// short keeps the landscape text size and wraps to its narrower width. Every canvas has its
+// own frame directory: imagenes_generadas for 1920x1080, imagenes_generadas_<w>x<h> otherwise.
+struct Canvas {
+    int width = IMG_WIDTH;
+    int height = IMG_HEIGHT;
+    string outputDir;
+    int fontHeightEn = FONT_HEIGHT_EN;
+    int fontHeightEs = FONT_HEIGHT_ES;
+    int fontHeightFragmentoEs = FONT_HEIGHT_FRAGMENTO_ES;
+    int lineSpacing = LINE_SPACING;
+    int rectVerticalPadding = RECT_VERTICAL_PADDING;
+    int topTextOffsetFragmento = TOP_TEXT_OFFSET_FRAGMENTO;
+    int bottomTextOffsetEspanol = BOTTOM_TEXT_OFFSET_ESPANOL;
+    int sectionSpacing = SECTION_SPACING;
+    int minHeightEnSection = MIN_HEIGHT_EN_SECTION;
+    int minHeightEsSection = MIN_HEIGHT_ES_SECTION;
+    int heightFragmentoEsSection = HEIGHT_FRAGMENTO_ES_SECTION;
+    int maxPanelHeight = 0; // --auto-ajuste: tallest panel before the text is shrunk (0 = off)
+
+    Size size() const { return Size(width, height); }
+    string name() const { return to_string(width) + "x" + to_string(height); }
+};
+
+Canvas makeCanvas(int width, int height) {
+    Canvas canvas;
+    canvas.width = width;
+    canvas.height = height;
+    canvas.outputDir = (width == IMG_WIDTH && height == IMG_HEIGHT) ? "imagenes_generadas" : "imagenes_generadas_" + canvas.name();
+
+    const double scale = min(width, height) / 1080.0;
+    auto scaled = [&](int value) { return static_cast<int>(lround(value * scale)); };
+    canvas.fontHeightEn = scaled(FONT_HEIGHT_EN);
+    canvas.fontHeightEs = scaled(FONT_HEIGHT_ES);
+    canvas.fontHeightFragmentoEs = scaled(FONT_HEIGHT_FRAGMENTO_ES);
+    canvas.lineSpacing = scaled(LINE_SPACING);
+    canvas.rectVerticalPadding = scaled(RECT_VERTICAL_PADDING);
+    canvas.topTextOffsetFragmento = scaled(TOP_TEXT_OFFSET_FRAGMENTO);
+    canvas.bottomTextOffsetEspanol = scaled(BOTTOM_TEXT_OFFSET_ESPANOL);
+    canvas.sectionSpacing = scaled(SECTION_SPACING);
+    canvas.minHeightEnSection = scaled(MIN_HEIGHT_EN_SECTION);
+    canvas.minHeightEsSection = scaled(MIN_HEIGHT_ES_SECTION);
+    canvas.heightFragmentoEsSection = scaled(HEIGHT_FRAGMENTO_ES_SECTION);
+    return canvas;
+}
+
+// Panel geometry of one phrase in frame coordinates: the dark rect and its three sections.
+struct PanelLayout {
+    Rect mainRect;
+    Rect fragmentoEs;
+    Rect englishSection;
+    Rect spanishSection;
+};
+
+PanelLayout computePanelLayout(const PhraseJob& job, TextLayoutEngine& layoutEngine, const Canvas& canvas) {
+    int main_rect_width = canvas.width;
+    int main_rect_x = (canvas.width - main_rect_width) / 2;
+    int effective_text_content_width = static_cast<int>(main_rect_width * 0.95);
+
+    int required_height_fragmento_es_content = calculateWrappedTextHeight(layoutEngine, job.subfrases.empty() ? "" : job.subfrases[0].second, canvas.fontHeightFragmentoEs, effective_text_content_width, canvas.lineSpacing);
+    int required_height_en_content = calculateWrappedTextHeight(layoutEngine, job.frase_en, canvas.fontHeightEn, effective_text_content_width, canvas.lineSpacing);
+    int required_height_es_content = calculateWrappedTextHeight(layoutEngine, job.frase_es, canvas.fontHeightEs, effective_text_content_width, canvas.lineSpacing);
+
+    int actual_height_fragmento_es_section = max(canvas.heightFragmentoEsSection, required_height_fragmento_es_content + canvas.rectVerticalPadding);
+    int actual_height_en_section = max(canvas.minHeightEnSection, required_height_en_content + canvas.rectVerticalPadding);
+    int actual_height_es_section = max(canvas.minHeightEsSection, required_height_es_content + canvas.rectVerticalPadding);
+
+    const int spacing = canvas.sectionSpacing;
+    int total_main_rect_height = actual_height_fragmento_es_section + spacing + actual_height_en_section + spacing + actual_height_es_section;
+    int main_rect_y = canvas.height - total_main_rect_height;
+
+    PanelLayout layout;
+    layout.mainRect = Rect(main_rect_x, main_rect_y, main_rect_width, total_main_rect_height);
+    layout.fragmentoEs = Rect(main_rect_x, main_rect_y, main_rect_width, actual_height_fragmento_es_section);
+    layout.englishSection = Rect(main_rect_x, main_rect_y + actual_height_fragmento_es_section + spacing, main_rect_width, actual_height_en_section);
+    layout.spanishSection = Rect(main_rect_x, main_rect_y + actual_height_fragmento_es_section + spacing + actual_height_en_section + spacing, main_rect_width, actual_height_es_section);
+    return layout;
+}
+
+// Canvas with its font heights and line spacing at `percent` of their values.
+Canvas scaleCanvasText(const Canvas& canvas, int percent) {
+    Canvas scaled = canvas;
+    auto scale = [&](int value) { return max(1, static_cast<int>(lround(value * percent / 100.0))); };
+    scaled.fontHeightEn = scale(canvas.fontHeightEn);
+    scaled.fontHeightEs = scale(canvas.fontHeightEs);
+    scaled.fontHeightFragmentoEs = scale(canvas.fontHeightFragmentoEs);
+    scaled.lineSpacing = scale(canvas.lineSpacing);
+    return scaled;
+}
 
-            ft2->putText(img, segment_to_draw, Point(current_draw_x, baseline_y), fontHeight, drawColor, -1, LINE_AA, true);
-            current_draw_x += ft2->getTextSize(segment_to_draw, fontHeight, -1, nullptr).width;
-            current_char_in_line_index = segment_end_in_line_index;
+// Text scale of one phrase under --auto-ajuste: the largest percentage (AUTO_FIT_MIN_PERCENT
+// to 100) at which its panel is no taller than canvas.maxPanelHeight, found by binary search.
+// Probes go through the memoized layout engine, so a phrase that already fits costs one
+// layout per text and one that does not about six; phrases that cannot fit get the minimum.
+int autoFitPercent(const PhraseJob& job, TextLayoutEngine& layoutEngine, const Canvas& canvas) {
+    if (canvas.maxPanelHeight <= 0) return 100;
+    auto fits = [&](int percent) {
+        return computePanelLayout(job, layoutEngine, scaleCanvasText(canvas, percent)).mainRect.height <= canvas.maxPanelHeight;
+    };
+    if (fits(100)) return 100;
+    int low = AUTO_FIT_MIN_PERCENT, high = 99; // The answer lies in [low, high]
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (fits(mid)) low = mid;
+        else high = mid - 1;
+    }
+    return low;
+}
+
+// Canvas a phrase is drawn with: the canvas itself, or its auto-fitted text scale.
+Canvas fitCanvasToPhrase(const PhraseJob& job, TextLayoutEngine& layoutEngine, const Canvas& canvas) {
+    int percent = autoFitPercent(job, layoutEngine, canvas);
+    return percent == 100 ? canvas : scaleCanvasText(canvas, percent);
+}
+
+// Renders every frame of one phrase on one canvas into the frame sink: a FrameStore, or a
+// FrameStreamer in stream mode. Returns false if the background image cannot be loaded.
+template <typename FrameSink>
+bool renderPhrase(const PhraseJob& job, RenderContext& ctx, BackgroundCache& backgrounds, const Canvas& targetCanvas, FrameSink& frameStore) {
+    TextLayoutEngine& layoutEngine = ctx.layoutEngine;
+    const int textPercent = autoFitPercent(job, layoutEngine, targetCanvas);
+    const Canvas canvas = textPercent == 100 ? targetCanvas : scaleCanvasText(targetCanvas, textPercent);
+    if (textPercent < 100) {
+        logLine("🔎 Frase " + to_string(job.index + 1) + " (" + targetCanvas.name() + "): texto al "
+                + to_string(textPercent) + "% para que el panel quepa.");
+    }
+
+    const Mat& backgroundImage = backgrounds.get(job.background_path, canvas.size());
+    if (backgroundImage.empty()) {
+        logLine("Error: No se pudo cargar la imagen de fondo desde " + job.background_path + "\n"
+                "Asegurese de que la carpeta 'personajes' exista y contenga '" + fs::path(job.background_path).filename().string()
+                + "' en relacion con el ejecutable.");
+        return false;
+    }
+
+    const string& frase_en = job.frase_en;
+    const string& frase_es = job.frase_es;
+    const vector<pair<string, string>>& subfrases = job.subfrases;
+    const PanelLayout layout = computePanelLayout(job, layoutEngine, canvas);
+    const int panelTop = layout.mainRect.y;
+
+    // Only the rows from bandTop down are drawn on: the panel rows, or the shared tile rows in
+    // tile mode. Everything above comes straight from the background. The band starts on an
+    // even row so that it maps onto whole chroma rows of a 4:2:0 frame (--yuv).
+    const int bandTop = frameStore.tileMode() ? frameStore.tileY() : (panelTop & ~1);
+    const Point toBand(0, -bandTop);
+    const Rect mainRect = layout.mainRect + toBand;
+    const Rect rect_fragmento_es = layout.fragmentoEs + toBand;
+    const Rect rect_en_section = layout.englishSection + toBand;
+    const Rect rect_es_section = layout.spanishSection + toBand;
+
+    int contador_imagenes = job.first_frame;
+
+    // Frames are built as layers: the base plate (background + dark rect) is blended once,
+    // and each later frame starts from the previous layer instead of starting over.
+    // Layers are bands of pooled full-size buffers.
+    auto acquireBand = [&]() { return framePool.acquire(canvas.height, canvas.width, CV_8UC3).rowRange(bandTop, canvas.height); };
+    Mat basePlate = acquireBand();
+    backgroundImage.rowRange(bandTop, canvas.height).copyTo(basePlate);
+    applySemiTransparentRect(basePlate, mainRect);
+
+    // img1: base plate only
+    frameStore.store(contador_imagenes, backgroundImage, basePlate, panelTop);
+    contador_imagenes++;
+
+
+    // img2: plate + English
+    // The English sentence is laid out once; subphrase frames only recolour its highlighted glyphs.
+    const HighlightedText english(layoutEngine, frase_en, rect_en_section, canvas.fontHeightEn, 0, canvas.lineSpacing);
+    Mat img2 = acquireBand();
+    basePlate.copyTo(img2);
+    english.draw(img2, COLOR_TEXTO_INGLES_NUEVO);
+    frameStore.store(contador_imagenes, backgroundImage, img2, panelTop);
+    contador_imagenes++;
+
+
+    // img3: plate + English + Spanish
+    Mat img3 = img2; // The store keeps its own copy, so img2 can be drawn on in place
+    drawWrappedText(img3, layoutEngine, frase_es, rect_es_section, canvas.fontHeightEs, COLOR_TEXTO_ESPANOL_NUEVO, canvas.bottomTextOffsetEspanol, canvas.lineSpacing);
+    frameStore.store(contador_imagenes, backgroundImage, img3, panelTop);
+    contador_imagenes++;
+
+
+    // Subphrase frames start from img3, get the Spanish fragment, and have the English glyphs
+    // of the subphrase recoloured in place.
+    Mat img_fragmento;
+    for (const auto& subfrase : subfrases) {
+        if (!frameStore.needs(contador_imagenes) && !frameStore.needs(contador_imagenes + 1)) {
+            contador_imagenes += 2; // Not part of the video being streamed
+            continue;
         }
-        current_line_y_start += singleLineRenderHeight + LINE_SPACING;
+        if (img_fragmento.empty()) img_fragmento = acquireBand();
+        img3.copyTo(img_fragmento);
+
+        drawWrappedText(img_fragmento, layoutEngine, subfrase.second, rect_fragmento_es, canvas.fontHeightFragmentoEs, COLOR_TEXTO_SUBFRASE_NUEVO, canvas.topTextOffsetFragmento, canvas.lineSpacing);
+        english.highlight(img_fragmento, basePlate, subfrase.first, COLOR_TEXTO_INGLES_NUEVO, COLOR_TEXTO_SUBFRASE_NUEVO);
+
+        frameStore.store(contador_imagenes, backgroundImage, img_fragmento, panelTop);
+        contador_imagenes++;
+
+        frameStore.store(contador_imagenes, backgroundImage, img_fragmento, panelTop); // Repeat, recorded in the manifest only
+        contador_imagenes++;
     }
+
+    // img_final shows the same English + Spanish layer as img3
+    frameStore.store(contador_imagenes, backgroundImage, img3, panelTop);
+    contador_imagenes++;
+
+    frameStore.store(contador_imagenes, backgroundImage, img3, panelTop); // Repeat, recorded in the manifest only
+    contador_imagenes++;
+
+    return true;
 }
 
-int main() {
-    // Define font path (constant)
-    const string FUENTE = "Montserrat-Bold.ttf";
+// Command-line options of imagenes.exe
+struct RenderOptions {
+    int threads = 0;          // 0 = one worker per hardware thread
+    int encoderThreads = 0;   // 0 = half of the hardware threads
+    int queueCapacity = 16;   // Frames waiting for the encoders before the renderers block
+    int pngCompression = -1;  // -1 = OpenCV default
+    FrameFormat format = FrameFormat::Png;
+    bool benchmarkBlend = false;  // Run the blend benchmark and exit
+    bool checkAtlas = false;      // Compare atlas-drawn text with FreeType2::putText and exit
+    bool tiles = false;           // Write backgrounds once plus RGBA panel tiles per frame
+    vector<string> streamJobs;    // Stream job files: pipe frames to ffmpeg instead of writing them, one video each
+    int memoryBudgetMb = 1024;    // Compressed frames shared between the videos of one stream run
+    bool indicesOnly = false;     // Only write IndicesImagenes.txt (the frames are streamed later)
+    bool incremental = false;     // Keep the frames of phrases that did not change since the last run
+    vector<Canvas> canvases;      // Output canvases, 1920x1080 unless --lienzos says otherwise
+    bool draft = false;           // Preview: canvases at half width and height, cheap PNG
+    int autoFitPercent = 0;       // Tallest panel as a percentage of the canvas height (0 = fixed font sizes)
+    bool yuv = false;             // Stream 4:2:0 frames (y4m) instead of BGR
+    bool labels = false;          // Also write the English-only and English+Spanish frames with their label
+};
+
+// Parses "1920x1080,1080x1920,...". Sizes must be even for 4:2:0 video; repeats are ignored.
+bool parseCanvasList(const string& list, vector<Canvas>& canvases) {
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        int width = 0, height = 0;
+        char separator = 0;
+        stringstream size(trim(item));
+        if (!(size >> width >> separator >> height) || (separator != 'x' && separator != 'X') ||
+            width < 2 || height < 2 || width > 8192 || height > 8192 || width % 2 || height % 2) {
+            return false;
+        }
+        bool repeated = false;
+        for (const Canvas& canvas : canvases) repeated |= canvas.width == width && canvas.height == height;
+        if (!repeated) canvases.push_back(makeCanvas(width, height));
+    }
+    return !canvases.empty();
+}
 
-    string output_dir = "imagenes_generadas";
+bool parseArguments(int argc, char* argv[], RenderOptions& options) {
+    auto readInt = [&](int& i, const string& name, int& target) {
+        if (i + 1 >= argc) {
+            cerr << "Error: '" << name << "' espera un numero entero." << endl;
+            return false;
+        }
+        try {
+            target = stoi(argv[++i]);
+        } catch (const exception&) {
+            cerr << "Error: '" << name << "' espera un numero entero." << endl;
+            return false;
+        }
+        return true;
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--hilos") {
+            if (!readInt(i, arg, options.threads)) return false;
+        } else if (arg == "--hilos-escritura") {
+            if (!readInt(i, arg, options.encoderThreads)) return false;
+        } else if (arg == "--cola-frames") {
+            if (!readInt(i, arg, options.queueCapacity)) return false;
+        } else if (arg == "--compresion-png") {
+            if (!readInt(i, arg, options.pngCompression)) return false;
+        } else if (arg == "--formato") {
+            if (i + 1 >= argc || !parseFrameFormat(argv[++i], options.format)) {
+                cerr << "Error: '--formato' espera png, qoi, webp o bmp." << endl;
+                return false;
+            }
+        } else if (arg == "--benchmark-mezcla") {
+            options.benchmarkBlend = true;
+        } else if (arg == "--verificar-atlas") {
+            options.checkAtlas = true;
+        } else if (arg == "--teselas") {
+            options.tiles = true;
+        } else if (arg == "--stream") {
+            if (i + 1 >= argc) {
+                cerr << "Error: '--stream' espera la ruta de un trabajo de streaming." << endl;
+                return false;
+            }
+            options.streamJobs.push_back(argv[++i]);
+        } else if (arg == "--solo-indices") {
+            options.indicesOnly = true;
+        } else if (arg == "--incremental") {
+            options.incremental = true;
+        } else if (arg == "--auto-ajuste") {
+            if (!readInt(i, arg, options.autoFitPercent)) return false;
+            if (options.autoFitPercent < 10 || options.autoFitPercent > 100) {
+                cerr << "Error: '--auto-ajuste' espera el alto maximo del panel en % del alto de la imagen (10-100)." << endl;
+                return false;
+            }
+        } else if (arg == "--draft") {
+            options.draft = true;
+        } else if (arg == "--memoria-mb") {
+            if (!readInt(i, arg, options.memoryBudgetMb)) return false;
+        } else if (arg == "--yuv") {
+            options.yuv = true;
+        } else if (arg == "--rotulos") {
+            options.labels = true;
+        } else if (arg == "--lienzos") {
+            if (i + 1 >= argc || !parseCanvasList(argv[++i], options.canvases)) {
+                cerr << "Error: '--lienzos' espera una lista de tamanos pares, por ejemplo 1920x1080,1080x1920,1080x1080." << endl;
+                return false;
+            }
+        } else {
+            cerr << "Error: Argumento desconocido '" << arg << "'." << endl;
+            cerr << "Uso: imagenes.exe [--hilos N] [--hilos-escritura N] [--cola-frames N] [--compresion-png 0-9] [--formato png|qoi|webp|bmp] [--teselas] [--stream trabajo.txt ...] [--memoria-mb N] [--solo-indices] [--incremental] [--lienzos 1920x1080,1080x1920,...] [--draft] [--auto-ajuste 10-100] [--yuv] [--rotulos] [--benchmark-mezcla] [--verificar-atlas]" << endl;
+            return false;
+        }
+    }
+    options.threads = max(0, options.threads);
+    options.encoderThreads = max(0, options.encoderThreads);
+    options.queueCapacity = max(1, options.queueCapacity);
+    if (options.canvases.empty()) {
+        options.canvases.push_back(makeCanvas(IMG_WIDTH, IMG_HEIGHT));
+    }
+    if (options.draft) {
+        // A quarter of the pixels, written to the same directories so the rest of the
+        // pipeline picks the frames up unchanged. The draft size enters the phrase
+        // signatures, so --incremental never mixes draft and full frames.
+        for (Canvas& canvas : options.canvases) {
+            string outputDir = canvas.outputDir;
+            canvas = makeCanvas(max(2, (canvas.width / 2) & ~1), max(2, (canvas.height / 2) & ~1));
+            canvas.outputDir = outputDir;
+        }
+        if (options.format == FrameFormat::Png && options.pngCompression < 0) {
+            options.pngCompression = 1;
+        }
+    }
+    for (Canvas& canvas : options.canvases) {
+        canvas.maxPanelHeight = canvas.height * options.autoFitPercent / 100;
+    }
+    options.memoryBudgetMb = max(0, options.memoryBudgetMb);
+    if (!options.streamJobs.empty() && options.canvases.size() > 1) {
+        cerr << "Error: '--stream' genera un solo video; indique un solo lienzo." << endl;
+        return false;
+    }
+    if (options.yuv && options.streamJobs.empty()) {
+        cerr << "Error: '--yuv' solo se usa con '--stream'." << endl;
+        return false;
+    }
+    if (options.labels && !options.streamJobs.empty()) {
+        cerr << "Error: '--rotulos' escribe imagenes a disco y no se usa con '--stream'." << endl;
+        return false;
+    }
+    if (options.tiles && options.format == FrameFormat::Bmp) {
+        cerr << "Error: '--teselas' necesita un formato con transparencia (png, qoi o webp)." << endl;
+        return false;
+    }
+    return true;
+}
 
+// Empties the frame directory (or creates it) so that no frames from an earlier run remain.
+// With keepFrames (--incremental) the frames are left in place; the render removes the ones
+// it no longer needs.
+bool prepareOutputDirectory(const string& output_dir, bool keepFrames) {
+    if (keepFrames && fs::is_directory(output_dir)) {
+        cout << "Modo incremental: se conservan los frames de '" << output_dir << "'." << endl;
+        return true;
+    }
     // --- Start: Clear 'imagenes_generadas' directory ---
     cout << "Limpiando la carpeta '" << output_dir << "'..." << endl;
     if (fs::exists(output_dir)) {
@@ -271,13 +1720,11 @@ int main() {
             } catch (const fs::filesystem_error& e) {
                 cerr << "❌ Error al limpiar la carpeta '" << output_dir << "': " << e.what() << endl;
                 cerr << "Por favor, cierre cualquier programa que este utilizando archivos en '" << output_dir << "' y vuelva a intentar." << endl;
-                system("pause");
-                return EXIT_FAILURE; // Exit if unable to clean
+                return false; // Exit if unable to clean
             }
         } else {
             cerr << "Error: La ruta '" << output_dir << "' existe pero no es un directorio. No se puede limpiar." << endl;
-            system("pause");
-            return EXIT_FAILURE;
+            return false;
         }
     } else {
         cout << "La carpeta '" << output_dir << "' no existe. Se creara." << endl;
@@ -291,12 +1738,316 @@ int main() {
         cout << "Directorio '" << output_dir << "' asegurado." << endl;
     } catch (const fs::filesystem_error& e) {
         cerr << "Error: No se pudo crear el directorio de salida '" << output_dir << "': " << e.what() << endl;
-        system("pause");
-        return EXIT_FAILURE;
+        return false;
     }
+    return true;
+}
 
-    // Initialize background image path index
-    int background_image_idx = 0; // 0 for 1000.png, 1 for 2000.png
+// Saves the frame lists and counts that image_preprocessor.cpp and generar_videos.cpp read
+// to IndicesImagenes.txt.
+void writeIndicesFile(const vector<int>& imagenes_ingles_solo, const vector<int>& imagenes_ingles_y_espanol, size_t total_frases, int total_frames) {
+    ofstream indices_file("IndicesImagenes.txt", ios::trunc); // Open in truncate mode to clear existing content
+    if (indices_file.is_open()) {
+        // Lista de imagenes solo en ingles
+        for (size_t i = 0; i < imagenes_ingles_solo.size(); ++i) {
+            indices_file << imagenes_ingles_solo[i] << (i == imagenes_ingles_solo.size() - 1 ? "" : ",");
+        }
+        indices_file << endl;
+
+        // Lista de imagenes en ingles y espanol
+        for (size_t i = 0; i < imagenes_ingles_y_espanol.size(); ++i) {
+            indices_file << imagenes_ingles_y_espanol[i] << (i == imagenes_ingles_y_espanol.size() - 1 ? "" : ",");
+        }
+        indices_file << endl;
+
+        // Total de frases procesadas
+        indices_file << total_frases << endl;
+        
+        // Total de imagenes generadas
+        indices_file << total_frames << endl;
+
+        indices_file.close();
+        cout << "✅ Indices de imagenes guardados en IndicesImagenes.txt" << endl;
+    } else {
+        cerr << "Error: No se pudo abrir el archivo IndicesImagenes.txt para escritura." << endl;
+    }
+}
+
+// 64-bit FNV-1a hash of a string.
+uint64_t hashText(const string& text) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// Size and modification time of a file, so edited backgrounds and fonts count as changes
+// without reading them.
+string fileStamp(const string& path) {
+    error_code ec;
+    uintmax_t size = fs::file_size(path, ec);
+    if (ec) return "?";
+    auto written = fs::last_write_time(path, ec);
+    return to_string(size) + "@" + to_string(ec ? 0 : static_cast<long long>(written.time_since_epoch().count()));
+}
+
+// Hash of everything that decides the frames of a phrase: its texts, subphrases and
+// background, the font, the style constants, the canvas and the output format. Phrases whose signature
+// matches the last run keep their frames under --incremental. The position of the phrase
+// is left out, so inserting a row only renumbers the phrases after it.
+string phraseSignature(const PhraseJob& job, const Canvas& canvas, const string& extension, int tileTop) {
+    stringstream ss;
+    ss << VERSION_RENDER << '\x1f' << job.frase_en << '\x1f' << job.frase_es;
+    for (const auto& subfrase : job.subfrases) {
+        ss << '\x1f' << subfrase.first << '\x1e' << subfrase.second;
+    }
+    ss << '\x1f' << job.background_path << '@' << fileStamp(job.background_path)
+       << '\x1f' << FUENTE << '@' << fileStamp(FUENTE)
+       << '\x1f' << canvas.name() << '|' << canvas.maxPanelHeight << '|' << extension << '|' << tileTop;
+    for (const Scalar& color : {COLOR_RECTANGULO_NUEVO, COLOR_TEXTO_INGLES_NUEVO, COLOR_TEXTO_SUBFRASE_NUEVO, COLOR_TEXTO_ESPANOL_NUEVO}) {
+        ss << '|' << color[0] << ',' << color[1] << ',' << color[2];
+    }
+    for (int value : {LINE_SPACING, RECT_VERTICAL_PADDING, TOP_TEXT_OFFSET_FRAGMENTO, BOTTOM_TEXT_OFFSET_ESPANOL, SECTION_SPACING,
+                      MIN_HEIGHT_EN_SECTION, MIN_HEIGHT_ES_SECTION, HEIGHT_FRAGMENTO_ES_SECTION,
+                      FONT_HEIGHT_EN, FONT_HEIGHT_ES, FONT_HEIGHT_FRAGMENTO_ES}) {
+        ss << '|' << value;
+    }
+    ss << '|' << RECTANGLE_OPACITY;
+    return FrameStore::hashToHex(hashText(ss.str()));
+}
+
+// Where the frames of a phrase were in the last run's manifest.
+struct CachedPhrase {
+    int first_frame = 0;
+    int frame_count = 0;
+};
+
+// Phrase cache of --incremental, one line per phrase: signature|first frame|frame count.
+map<string, CachedPhrase> readPhraseCache(const string& output_dir) {
+    map<string, CachedPhrase> cache;
+    ifstream file(output_dir + "/" + ARCHIVO_CACHE_FRASES);
+    string line;
+    while (getline(file, line)) {
+        stringstream ss(line);
+        string signature, first, count;
+        if (!getline(ss, signature, '|') || !getline(ss, first, '|') || !getline(ss, count, '|')) continue;
+        try {
+            cache[signature] = {stoi(first), stoi(count)};
+        } catch (const exception&) {}
+    }
+    return cache;
+}
+
+bool writePhraseCache(const string& output_dir, const vector<PhraseJob>& jobs, const vector<string>& signatures) {
+    ofstream file(output_dir + "/" + ARCHIVO_CACHE_FRASES, ios::trunc);
+    if (!file.is_open()) return false;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        file << signatures[i] << "|" << jobs[i].first_frame << "|" << jobs[i].frameCount() << "\n";
+    }
+    return file.good();
+}
+
+// Stream job written by generar_videos.cpp (--streaming). One field per line:
+//   fps|<frames per second>
+//   ffmpeg|<encoder arguments after the video input: audio input, codecs, output file>
+//   frame|<frame number>|<seconds>   (one line per image of the video, in order)
+struct StreamJob {
+    int fps = 25;
+    string encoderArguments;
+    vector<FrameStreamer::Entry> entries;
+};
+
+bool readStreamJob(const string& path, StreamJob& job) {
+    ifstream file(path);
+    if (!file.is_open()) {
+        cerr << "Error: No se pudo abrir el trabajo de streaming '" << path << "'." << endl;
+        return false;
+    }
+    string line;
+    while (getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t bar = line.find('|');
+        if (bar == string::npos) continue;
+        string key = line.substr(0, bar);
+        string value = line.substr(bar + 1);
+        try {
+            if (key == "fps") {
+                job.fps = max(1, stoi(value));
+            } else if (key == "ffmpeg") {
+                job.encoderArguments = value;
+            } else if (key == "frame") {
+                size_t second_bar = value.find('|');
+                FrameStreamer::Entry entry;
+                entry.frame = stoi(value.substr(0, second_bar));
+                entry.duration = second_bar == string::npos ? 0.0 : stod(value.substr(second_bar + 1));
+                job.entries.push_back(entry);
+            }
+        } catch (const exception&) {
+            cerr << "Advertencia: Linea invalida en el trabajo de streaming: " << line << endl;
+        }
+    }
+    if (job.encoderArguments.empty() || job.entries.empty()) {
+        cerr << "Error: El trabajo de streaming '" << path << "' no tiene argumentos de ffmpeg o frames." << endl;
+        return false;
+    }
+    return true;
+}
+
+// Prints how often the shaped-run caches of the workers answered a measure or draw call, and
+// how many frame buffers the run needed.
+void reportRenderStats(const vector<unique_ptr<RenderContext>>& contexts) {
+    size_t hits = 0, misses = 0;
+    for (const auto& ctx : contexts) {
+        hits += ctx->atlas.shapeHits();
+        misses += ctx->atlas.shapeMisses();
+    }
+    if (hits + misses > 0) {
+        cout << "   Cache de texto: " << fixed << setprecision(1) << 100.0 * hits / (hits + misses) << defaultfloat
+             << "% de aciertos (" << misses << " cadenas distintas, " << hits + misses << " consultas)." << endl;
+    }
+    cout << "   Buffers de frame: " << framePool.allocatedBuffers() << " reservados, "
+         << framePool.reusedBuffers() << " reutilizaciones." << endl;
+}
+
+// Streams one video: renders the phrases whose frames the job needs and are not in frameCache,
+// and pipes the frames to ffmpeg as raw BGR video, or as a y4m stream of 4:2:0 frames with
+// --yuv. Frames in `keep` are added to frameCache for the videos that follow.
+bool streamVideo(const RenderOptions& options, const StreamJob& streamJob, const vector<PhraseJob>& jobs,
+                 vector<unique_ptr<RenderContext>>& contexts, BackgroundCache& backgroundCache,
+                 CompressedFrameCache& frameCache, const set<int>& keep) {
+    // A job out of date with Excel.txt may list frames that no phrase renders
+    const int total_frames = jobs.empty() ? 0 : jobs.back().first_frame + jobs.back().frameCount() - 1;
+    for (const FrameStreamer::Entry& entry : streamJob.entries) {
+        if (entry.frame < 1 || entry.frame > total_frames) {
+            cerr << "Error: El trabajo de streaming pide el frame " << entry.frame << ", pero Excel.txt solo genera "
+                 << total_frames << " frames. Vuelva a generar los indices de imagenes." << endl;
+            return false;
+        }
+    }
+
+    FrameStreamer streamer(streamJob.entries, static_cast<size_t>(options.queueCapacity), options.yuv, &frameCache, keep);
+
+    // Only phrases with at least one frame to render are rendered
+    const set<int>& wanted = streamer.renderedFrames();
+    vector<const PhraseJob*> needed;
+    for (const PhraseJob& job : jobs) {
+        auto it = wanted.lower_bound(job.first_frame);
+        if (it != wanted.end() && *it < job.first_frame + job.frameCount()) needed.push_back(&job);
+    }
+
+    const Canvas& canvas = options.canvases.front();
+    // The y4m header carries the frame size and rate
+    string command = options.yuv ? "ffmpeg -y -f yuv4mpegpipe -i - " + streamJob.encoderArguments
+                                 : "ffmpeg -y -f rawvideo -pix_fmt bgr24 -s " + canvas.name() +
+                                   " -r " + to_string(streamJob.fps) + " -i - " + streamJob.encoderArguments;
+    cout << "Ejecutando: " << command << endl;
+    FILE* pipe = _popen(command.c_str(), "wb");
+    if (!pipe) {
+        cerr << "Error: No se pudo iniciar ffmpeg para el streaming." << endl;
+        return false;
+    }
+
+    atomic<size_t> next_job{0};
+    atomic<bool> render_failed{false};
+    atomic<size_t> running_workers{contexts.size()};
+    auto worker = [&](RenderContext& ctx) {
+        while (!render_failed) {
+            size_t i = next_job++;
+            if (i >= needed.size()) break;
+            if (!renderPhrase(*needed[i], ctx, backgroundCache, canvas, streamer)) {
+                render_failed = true;
+                streamer.abort();
+            }
+        }
+        // The last worker out tells the writer, which would otherwise wait for a missing frame forever
+        if (--running_workers == 0) streamer.renderingFinished();
+    };
+
+    size_t fromCache = 0;
+    for (const FrameStreamer::Entry& entry : streamJob.entries) {
+        if (!wanted.count(entry.frame)) fromCache++;
+    }
+    cout << "Enviando " << streamJob.entries.size() << " imagenes a ffmpeg (" << fromCache << " desde la cache de frames); "
+         << needed.size() << " frases a renderizar con " << contexts.size() << " hilo(s)..." << endl;
+    vector<thread> workers;
+    for (auto& ctx : contexts) {
+        workers.emplace_back(worker, std::ref(*ctx));
+    }
+    bool written = streamer.writeAll(pipe, streamJob.fps);
+    if (!written) {
+        render_failed = true;
+        streamer.abort();
+    }
+    for (thread& t : workers) {
+        t.join();
+    }
+    int ffmpeg_status = _pclose(pipe);
+    if (!written || render_failed || ffmpeg_status != 0) {
+        cerr << "❌ Error: El streaming hacia ffmpeg fallo (codigo de salida " << ffmpeg_status << ")." << endl;
+        return false;
+    }
+    cout << "✅ Video generado por streaming." << endl;
+    return true;
+}
+
+// --stream: encodes the videos of every job in order, without writing image files. Frames that
+// a later video of the run also shows are kept LZ4-compressed in memory (--memoria-mb, spilling
+// to disk beyond that), so each distinct frame is rendered once per run. At most
+// queueCapacity uncompressed frames wait for the encoder.
+bool runStream(const RenderOptions& options, const vector<PhraseJob>& jobs, vector<unique_ptr<RenderContext>>& contexts) {
+    vector<StreamJob> streamJobs(options.streamJobs.size());
+    for (size_t i = 0; i < streamJobs.size(); ++i) {
+        if (!readStreamJob(options.streamJobs[i], streamJobs[i])) return false;
+    }
+
+    BackgroundCache backgroundCache;
+    CompressedFrameCache frameCache(static_cast<size_t>(options.memoryBudgetMb) * 1024 * 1024);
+    for (size_t i = 0; i < streamJobs.size(); ++i) {
+        set<int> keep; // Frames of the videos after this one
+        for (size_t later = i + 1; later < streamJobs.size(); ++later) {
+            for (const FrameStreamer::Entry& entry : streamJobs[later].entries) keep.insert(entry.frame);
+        }
+        if (streamJobs.size() > 1) {
+            cout << "\nVideo " << i + 1 << " de " << streamJobs.size() << " (" << options.streamJobs[i] << ")" << endl;
+        }
+        if (!streamVideo(options, streamJobs[i], jobs, contexts, backgroundCache, frameCache, keep)) return false;
+        frameCache.keepOnly(keep);
+    }
+    reportRenderStats(contexts);
+    frameCache.report();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    RenderOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        return 1;
+    }
+    if (options.benchmarkBlend) {
+        runBlendBenchmark();
+        return 0;
+    }
+    if (options.checkAtlas) {
+        Ptr<freetype::FreeType2> ft2 = freetype::createFreeType2();
+        try {
+            ft2->loadFontData(FUENTE, 0);
+        } catch (const cv::Exception& e) {
+            cerr << "Error: No se pudo cargar la fuente '" << FUENTE << "': " << e.what() << endl;
+            return 1;
+        }
+        return runAtlasCheck(ft2) ? 0 : 1;
+    }
+
+    const bool streaming = !options.streamJobs.empty();
+    // Stream mode leaves the frames on disk from earlier runs alone
+    for (const Canvas& canvas : options.canvases) {
+        if (!streaming && !prepareOutputDirectory(canvas.outputDir, options.incremental)) {
+            system("pause");
+            return EXIT_FAILURE;
+        }
+    }
 
     vector<vector<string>> frases_data;
     ifstream archivo(ARCHIVO_PLANTILLA);
@@ -321,182 +2072,245 @@ int main() {
     }
 
 
-    Ptr<freetype::FreeType2> ft2 = freetype::createFreeType2();
-    try {
-        ft2->loadFontData(FUENTE, 0);
-    } catch (const cv::Exception& e) {
-        cerr << "Error: No se pudo cargar la fuente '" << FUENTE << "'. Asegurese de que este en el mismo directorio que el ejecutable." << endl;
-        cerr << "Error de OpenCV FreeType: " << e.what() << endl;
+    vector<string> background_paths = listBackgroundImages(CARPETA_PERSONAJES);
+    if (background_paths.empty() && !frases_data.empty()) {
+        cerr << "Error: No se encontraron imagenes de fondo en la carpeta '" << CARPETA_PERSONAJES << "'." << endl;
+        cerr << "Asegurese de que contenga imagenes numeradas (por ejemplo '1000.png' y '2000.png') en relacion con el ejecutable." << endl;
         system("pause");
         return 1;
     }
-    
 
-    int spacing = 20; 
-
-    const int MIN_HEIGHT_EN_SECTION = 120;
-    const int MIN_HEIGHT_ES_SECTION = 80;
-    const int HEIGHT_FRAGMENTO_ES_SECTION = 80;
-
-    int fontHeight_en = static_cast<int>(75 * 1.15);
-    int fontHeight_es = static_cast<int>(55 * 1.15);
-    int fontHeight_fragmento_es = static_cast<int>(50 * 1.15);
-
-    int contador_imagenes = 1;
+    // Plan every phrase up front: background rotation and frame numbers (prefix sum of
+    // the per-phrase frame counts) do not depend on rendering order.
+    vector<PhraseJob> jobs;
+    int total_frames = 0;
     vector<int> imagenes_ingles_solo;
     vector<int> imagenes_ingles_y_espanol;
+    for (const auto& frase_data : frases_data) {
+        PhraseJob job;
+        job.index = static_cast<int>(jobs.size());
+        job.frase_en = frase_data[0];
+        job.frase_es = frase_data[1];
+        for (size_t i = 2; i + 1 < frase_data.size(); i += 2) {
+            job.subfrases.push_back({frase_data[i], frase_data[i + 1]});
+        }
+        job.background_path = background_paths[job.index % background_paths.size()];
+        job.first_frame = total_frames + 1;
+        total_frames += job.frameCount();
 
-    int main_rect_width = IMG_WIDTH;
-    int main_rect_x = (IMG_WIDTH - main_rect_width) / 2;
+        imagenes_ingles_solo.push_back(job.englishOnlyFrame());
+        imagenes_ingles_y_espanol.push_back(job.englishSpanishFrame());
+        jobs.push_back(std::move(job));
+    }
 
-    if (frases_data.empty()) {
+    if (jobs.empty()) {
         cout << "No se encontraron frases en Excel.txt. No se generaran imagenes." << endl;
     }
+    if (options.indicesOnly) {
+        writeIndicesFile(imagenes_ingles_solo, imagenes_ingles_y_espanol, frases_data.size(), total_frames);
+        return 0;
+    }
 
-    for (const auto& frase_data : frases_data) {
-        string current_background_image_path;
-        if (background_image_idx == 0) {
-            current_background_image_path = "personajes/1000.png";
-        } else {
-            current_background_image_path = "personajes/2000.png";
-        }
-        background_image_idx = 1 - background_image_idx;
-
-        Mat backgroundImage = imread(current_background_image_path);
-        if (backgroundImage.empty()) {
-            cerr << "Error: No se pudo cargar la imagen de fondo desde " << current_background_image_path << endl;
-            cerr << "Asegurese de que la carpeta 'personajes' exista y contenga '" 
-                 << (background_image_idx == 0 ? "2000.png" : "1000.png")
-                 << "' en relacion con el ejecutable." << endl;
+    int num_workers = options.threads > 0 ? options.threads : static_cast<int>(thread::hardware_concurrency());
+    num_workers = max(1, min(num_workers, static_cast<int>(jobs.size() * options.canvases.size())));
+
+    // Each worker gets its own FreeType instance; fonts are loaded here so errors are reported once.
+    vector<unique_ptr<RenderContext>> contexts;
+    for (int w = 0; w < num_workers; ++w) {
+        Ptr<freetype::FreeType2> ft2 = freetype::createFreeType2();
+        try {
+            ft2->loadFontData(FUENTE, 0);
+        } catch (const cv::Exception& e) {
+            cerr << "Error: No se pudo cargar la fuente '" << FUENTE << "'. Asegurese de que este en el mismo directorio que el ejecutable." << endl;
+            cerr << "Error de OpenCV FreeType: " << e.what() << endl;
             system("pause");
             return 1;
         }
-        resize(backgroundImage, backgroundImage, Size(IMG_WIDTH, IMG_HEIGHT), 0, 0, INTER_LINEAR);
+        contexts.push_back(make_unique<RenderContext>(ft2));
+    }
 
+    if (streaming) {
+        return runStream(options, jobs, contexts) ? 0 : 1;
+    }
 
-        string frase_en = frase_data[0];
-        string frase_es = frase_data[1];
-        vector<pair<string, string>> subfrases;
-        for (size_t i = 2; i + 1 < frase_data.size(); i += 2) {
-            subfrases.push_back({frase_data[i], frase_data[i + 1]});
+    int hardware_threads = max(1, static_cast<int>(thread::hardware_concurrency()));
+    int encoder_threads = options.encoderThreads > 0 ? options.encoderThreads : max(1, hardware_threads / 2);
+    AsyncFrameWriter frameWriter(encoder_threads, options.queueCapacity, options.format, options.pngCompression);
+
+    // Every canvas gets its own frame store, manifest and phrase cache. The encoders, the
+    // workers and their glyph and shaping caches are shared by all of them.
+    struct CanvasOutput {
+        const Canvas* canvas;
+        unique_ptr<FrameStore> frameStore;
+        vector<string> signatures;
+    };
+    vector<CanvasOutput> outputs;
+    // (phrase, canvas) pairs to render, phrase by phrase, so one worker draws a phrase on
+    // every canvas while its strings are still in the caches.
+    vector<pair<const PhraseJob*, size_t>> pending_jobs;
+    for (const Canvas& canvas : options.canvases) {
+        // Tile mode needs one tile height for the whole video, since the assembler overlays every
+        // tile at the same position: it starts at the highest panel top of all phrases (kept even
+        // for 4:2:0 chroma).
+        int tile_y = -1;
+        if (options.tiles) {
+            tile_y = canvas.height;
+            for (const PhraseJob& job : jobs) {
+                TextLayoutEngine& layoutEngine = contexts[0]->layoutEngine;
+                tile_y = min(tile_y, computePanelLayout(job, layoutEngine, fitCanvasToPhrase(job, layoutEngine, canvas)).mainRect.y);
+            }
+            tile_y = max(0, tile_y) & ~1;
+            cout << "Modo teselas (" << canvas.name() << "): cada frame guarda las filas " << tile_y << "-" << canvas.height
+                 << " (" << (canvas.height - tile_y) * 100 / canvas.height << "% de la imagen)." << endl;
         }
 
-        int effective_text_content_width = static_cast<int>(main_rect_width * 0.95);
-
-        int required_height_fragmento_es_content = calculateWrappedTextHeight(ft2, subfrases.empty() ? "" : subfrases[0].second, fontHeight_fragmento_es, effective_text_content_width);
-        int required_height_en_content = calculateWrappedTextHeight(ft2, frase_en, fontHeight_en, effective_text_content_width);
-        int required_height_es_content = calculateWrappedTextHeight(ft2, frase_es, fontHeight_es, effective_text_content_width);
-
-        int actual_height_fragmento_es_section = max(HEIGHT_FRAGMENTO_ES_SECTION, required_height_fragmento_es_content + RECT_VERTICAL_PADDING);
-        int actual_height_en_section = max(MIN_HEIGHT_EN_SECTION, required_height_en_content + RECT_VERTICAL_PADDING);
-        int actual_height_es_section = max(MIN_HEIGHT_ES_SECTION, required_height_es_content + RECT_VERTICAL_PADDING);
-        
-        int total_main_rect_height = actual_height_fragmento_es_section + spacing + actual_height_en_section + spacing + actual_height_es_section;
-        int main_rect_y = IMG_HEIGHT - total_main_rect_height;
-        Rect mainRect(main_rect_x, main_rect_y, main_rect_width, total_main_rect_height);
-
-
-        auto applySemiTransparentRect = [&](Mat& targetImage, const Rect& rectToOverlay) {
-            if (rectToOverlay.width <= 0 || rectToOverlay.height <= 0) return;
-            Mat roi = targetImage(rectToOverlay);
-            Mat coloredOverlay(roi.size(), targetImage.type(), COLOR_RECTANGULO_NUEVO);
-            addWeighted(coloredOverlay, RECTANGLE_OPACITY, roi, 1.0 - RECTANGLE_OPACITY, 0.0, roi);
-        };
-
-        Mat img1 = backgroundImage.clone();
-        applySemiTransparentRect(img1, mainRect);
-        imwrite(output_dir + "/" + to_string(contador_imagenes) + ".png", img1);
-        cout << "✅ Imagen generada: " << output_dir + "/" + to_string(contador_imagenes) + ".png" << endl;
-        contador_imagenes++;
-
-
-        Mat img2 = backgroundImage.clone();
-        applySemiTransparentRect(img2, mainRect);
-        Rect rect_en_section_img2(mainRect.x, mainRect.y + actual_height_fragmento_es_section + spacing, mainRect.width, actual_height_en_section);
-        drawWrappedText(img2, ft2, frase_en, rect_en_section_img2, fontHeight_en, COLOR_TEXTO_INGLES_NUEVO);
-        imwrite(output_dir + "/" + to_string(contador_imagenes) + ".png", img2);
-        imagenes_ingles_solo.push_back(contador_imagenes);
-        cout << "✅ Imagen generada: " << output_dir + "/" + to_string(contador_imagenes) + ".png" << endl;
-        contador_imagenes++;
-
-
-        Mat img3 = backgroundImage.clone();
-        applySemiTransparentRect(img3, mainRect);
-        Rect rect_en_section_img3(mainRect.x, mainRect.y + actual_height_fragmento_es_section + spacing, mainRect.width, actual_height_en_section);
-        drawWrappedText(img3, ft2, frase_en, rect_en_section_img3, fontHeight_en, COLOR_TEXTO_INGLES_NUEVO);
-        Rect rect_es_section_img3(mainRect.x, mainRect.y + actual_height_fragmento_es_section + spacing + actual_height_en_section + spacing, mainRect.width, actual_height_es_section);
-        drawWrappedText(img3, ft2, frase_es, rect_es_section_img3, fontHeight_es, COLOR_TEXTO_ESPANOL_NUEVO, BOTTOM_TEXT_OFFSET_ESPANOL);
-        imwrite(output_dir + "/" + to_string(contador_imagenes) + ".png", img3);
-        imagenes_ingles_y_espanol.push_back(contador_imagenes);
-        cout << "✅ Imagen generada: " << output_dir + "/" + to_string(contador_imagenes) + ".png" << endl;
-        contador_imagenes++;
-
-
-        for (const auto& subfrase : subfrases) {
-            Mat img_fragmento = backgroundImage.clone();
-            applySemiTransparentRect(img_fragmento, mainRect);
-
-            Rect rect_fragmento_es(mainRect.x, mainRect.y, mainRect.width, actual_height_fragmento_es_section);
-            drawWrappedText(img_fragmento, ft2, subfrase.second, rect_fragmento_es, fontHeight_fragmento_es, COLOR_TEXTO_SUBFRASE_NUEVO, TOP_TEXT_OFFSET_FRAGMENTO);
-
-            Rect rect_en_highlight_section(mainRect.x, mainRect.y + actual_height_fragmento_es_section + spacing, mainRect.width, actual_height_en_section);
-            drawWrappedTextWithHighlight(img_fragmento, ft2, frase_en, subfrase.first, rect_en_highlight_section, fontHeight_en, COLOR_TEXTO_INGLES_NUEVO, COLOR_TEXTO_SUBFRASE_NUEVO);
-            
-            Rect rect_es_section(mainRect.x, mainRect.y + actual_height_fragmento_es_section + spacing + actual_height_en_section + spacing, mainRect.width, actual_height_es_section);
-            drawWrappedText(img_fragmento, ft2, frase_es, rect_es_section, fontHeight_es, COLOR_TEXTO_ESPANOL_NUEVO, BOTTOM_TEXT_OFFSET_ESPANOL);
+        CanvasOutput output{&canvas, make_unique<FrameStore>(canvas.outputDir, frameWriter, tile_y), {}};
+        output.frameStore->setReuseFilesOnDisk(options.incremental);
+        for (const PhraseJob& job : jobs) {
+            output.signatures.push_back(phraseSignature(job, canvas, frameExtension(options.format), tile_y));
+        }
+        outputs.push_back(std::move(output));
+    }
 
-            imwrite(output_dir + "/" + to_string(contador_imagenes) + ".png", img_fragmento);
-            cout << "✅ Imagen generada: " << output_dir + "/" + to_string(contador_imagenes) + ".png" << endl;
-            contador_imagenes++;
+    // --rotulos: the labels go on the frames in imagenes_generadas (the 1920x1080 canvas or its
+    // draft), which image_preprocessor.cpp used to read back to stamp them.
+    const CanvasOutput* labelled_output = nullptr;
+    LabelledFrameWriter labelled_frames(frameWriter);
+    LabelSprite label_en, label_en_es;
+    if (options.labels) {
+        for (const CanvasOutput& output : outputs) {
+            if (output.canvas->outputDir == "imagenes_generadas") labelled_output = &output;
+        }
+        if (labelled_output == nullptr) {
+            cerr << "Error: '--rotulos' necesita el lienzo 1920x1080 entre los de '--lienzos'." << endl;
+            system("pause");
+            return 1;
+        }
+        error_code ec;
+        fs::create_directories(CARPETA_ROTULO_INGLES, ec);
+        fs::create_directories(CARPETA_ROTULO_INGLES_ESPANOL, ec);
+        const Size label_size = labelled_output->canvas->size();
+        label_en = buildSubtitleLabel(contexts[0]->ft2, TEXTO_SUBTITULOS_EN, FONT_HEIGHT_SUBTITLES_EN, label_size);
+        label_en_es = buildSubtitleLabel(contexts[0]->ft2, TEXTO_SUBTITULOS_EN_ES, FONT_HEIGHT_SUBTITLES_EN_ES, label_size);
+        for (const PhraseJob& job : jobs) {
+            labelled_frames.add(job.englishOnlyFrame(), CARPETA_ROTULO_INGLES + "/" + to_string(job.englishOnlyFrame()) + frameWriter.extension(), label_en);
+            labelled_frames.add(job.englishSpanishFrame(), CARPETA_ROTULO_INGLES_ESPANOL + "/" + to_string(job.englishSpanishFrame()) + frameWriter.extension(), label_en_es);
+        }
+        labelled_output->frameStore->setLabelledFrames(&labelled_frames);
+    }
 
-            imwrite(output_dir + "/" + to_string(contador_imagenes) + ".png", img_fragmento); // Repeat
-            cout << "✅ Imagen generada: " << output_dir + "/" + to_string(contador_imagenes) + ".png" << endl;
-            contador_imagenes++;
+    // Incremental mode: phrases whose signature is in the last run's cache take their frames
+    // from the old manifest, renumbered to their new position; only the rest are rendered.
+    // The cache is written on every run, so the run after a full render can be incremental.
+    for (CanvasOutput& output : outputs) {
+        map<int, FrameStore::ManifestEntry> old_frames;
+        map<string, CachedPhrase> cache;
+        if (options.incremental && FrameStore::readManifest(output.canvas->outputDir, old_frames)) {
+            cache = readPhraseCache(output.canvas->outputDir);
+        }
+        size_t reused = 0;
+        for (const PhraseJob& job : jobs) {
+            auto cached = cache.find(output.signatures[job.index]);
+            bool reusable = cached != cache.end() && cached->second.frame_count == job.frameCount();
+            for (int f = 0; reusable && f < job.frameCount(); ++f) {
+                auto old = old_frames.find(cached->second.first_frame + f);
+                reusable = old != old_frames.end() && output.frameStore->onDisk(old->second);
+            }
+            if (!reusable) continue;
+            for (int f = 0; f < job.frameCount(); ++f) {
+                output.frameStore->adopt(job.first_frame + f, old_frames[cached->second.first_frame + f]);
+            }
+            reused++;
+        }
+        if (options.incremental) {
+            cout << "Modo incremental (" << output.canvas->name() << "): " << reused << " de " << jobs.size()
+                 << " frases sin cambios." << endl;
         }
+    }
+    for (const PhraseJob& job : jobs) {
+        for (size_t c = 0; c < outputs.size(); ++c) {
+            if (!outputs[c].frameStore->hasFrame(job.first_frame)) pending_jobs.push_back({&job, c});
+        }
+    }
+    // Phrases reused by --incremental are not rendered into their frame store, but their
+    // labelled frames are numbered by the new position, so those are rendered on their own.
+    vector<const PhraseJob*> label_jobs;
+    if (labelled_output != nullptr) {
+        for (const PhraseJob& job : jobs) {
+            if (labelled_output->frameStore->hasFrame(job.first_frame)) label_jobs.push_back(&job);
+        }
+    }
 
-        Mat img_final = backgroundImage.clone();
-        applySemiTransparentRect(img_final, mainRect);
-        Rect rect_en_final_section(mainRect.x, mainRect.y + actual_height_fragmento_es_section + spacing, mainRect.width, actual_height_en_section);
-        drawWrappedText(img_final, ft2, frase_en, rect_en_final_section, fontHeight_en, COLOR_TEXTO_INGLES_NUEVO);
-        Rect rect_es_final_section(mainRect.x, mainRect.y + actual_height_fragmento_es_section + spacing + actual_height_en_section + spacing, mainRect.width, actual_height_es_section);
-        drawWrappedText(img_final, ft2, frase_es, rect_es_final_section, fontHeight_es, COLOR_TEXTO_ESPANOL_NUEVO, BOTTOM_TEXT_OFFSET_ESPANOL);
-        imwrite(output_dir + "/" + to_string(contador_imagenes) + ".png", img_final);
-        cout << "✅ Imagen generada: " << output_dir + "/" + to_string(contador_imagenes) + ".png" << endl;
-        contador_imagenes++;
+    BackgroundCache backgroundCache;
+    atomic<size_t> next_job{0};
+    atomic<bool> render_failed{false};
+    auto worker = [&](RenderContext& ctx) {
+        while (!render_failed) {
+            size_t i = next_job++;
+            bool rendered;
+            if (i < pending_jobs.size()) {
+                const CanvasOutput& output = outputs[pending_jobs[i].second];
+                rendered = renderPhrase(*pending_jobs[i].first, ctx, backgroundCache, *output.canvas, *output.frameStore);
+            } else if (i - pending_jobs.size() < label_jobs.size()) {
+                rendered = renderPhrase(*label_jobs[i - pending_jobs.size()], ctx, backgroundCache, *labelled_output->canvas, labelled_frames);
+            } else {
+                break;
+            }
+            if (!rendered) {
+                render_failed = true;
+            }
+        }
+    };
 
-        imwrite(output_dir + "/" + to_string(contador_imagenes) + ".png", img_final); // Repeat
-        cout << "✅ Imagen generada: " << output_dir + "/" + to_string(contador_imagenes) + ".png" << endl;
-        contador_imagenes++;
+    cout << "Renderizando " << pending_jobs.size() << " frases en " << outputs.size() << " lienzo(s) con "
+         << num_workers << " hilo(s)..." << endl;
+    if (!label_jobs.empty()) {
+        cout << "   y los rotulos de " << label_jobs.size() << " frases sin cambios." << endl;
+    }
+    if (num_workers == 1 || pending_jobs.size() + label_jobs.size() <= 1) {
+        worker(*contexts[0]);
+    } else {
+        vector<thread> workers;
+        for (int w = 0; w < num_workers; ++w) {
+            workers.emplace_back(worker, std::ref(*contexts[w]));
+        }
+        for (thread& t : workers) {
+            t.join();
+        }
+    }
+    bool frames_written = frameWriter.finish();
+    if (render_failed || !frames_written) {
+        system("pause");
+        return 1;
     }
 
-    cout << "\n✨ Todas las imagenes han sido generadas en la carpeta: " << output_dir << endl;
+    for (const CanvasOutput& output : outputs) {
+        const string& output_dir = output.canvas->outputDir;
+        const FrameStore& frameStore = *output.frameStore;
+        cout << "\n✨ Todas las imagenes han sido generadas en la carpeta: " << output_dir << endl;
+        cout << "   " << frameStore.uniqueFrames() << " archivos unicos para " << frameStore.totalFrames() << " frames." << endl;
 
-    // Save lists and counts to IndicesImagenes.txt
-    ofstream indices_file("IndicesImagenes.txt", ios::trunc); // Open in truncate mode to clear existing content
-    if (indices_file.is_open()) {
-        // Lista de imagenes solo en ingles
-        for (size_t i = 0; i < imagenes_ingles_solo.size(); ++i) {
-            indices_file << imagenes_ingles_solo[i] << (i == imagenes_ingles_solo.size() - 1 ? "" : ",");
+        if (frameStore.writeManifest()) {
+            cout << "✅ Manifiesto de frames guardado en " << output_dir << "/" << ARCHIVO_MANIFIESTO << endl;
+        } else {
+            cerr << "Error: No se pudo escribir el manifiesto de frames en " << output_dir << "/" << ARCHIVO_MANIFIESTO << endl;
+            system("pause");
+            return 1;
         }
-        indices_file << endl;
 
-        // Lista de imagenes en ingles y espanol
-        for (size_t i = 0; i < imagenes_ingles_y_espanol.size(); ++i) {
-            indices_file << imagenes_ingles_y_espanol[i] << (i == imagenes_ingles_y_espanol.size() - 1 ? "" : ",");
+        if (!writePhraseCache(output_dir, jobs, output.signatures)) {
+            cerr << "Error: No se pudo escribir la cache de frases en " << output_dir << "/" << ARCHIVO_CACHE_FRASES << endl;
+        }
+        if (options.incremental) {
+            size_t removed = frameStore.removeUnreferencedFiles();
+            if (removed > 0) {
+                cout << "   " << removed << " archivo(s) de frames que ya no se usan eliminados." << endl;
+            }
         }
-        indices_file << endl;
-
-        // Total de frases procesadas
-        indices_file << frases_data.size() << endl;
-        
-        // Total de imagenes generadas
-        indices_file << contador_imagenes - 1 << endl;
-
-        indices_file.close();
-        cout << "✅ Indices de imagenes guardados en IndicesImagenes.txt" << endl;
-    } else {
-        cerr << "Error: No se pudo abrir el archivo IndicesImagenes.txt para escritura." << endl;
     }
+    reportRenderStats(contexts);
+
+    writeIndicesFile(imagenes_ingles_solo, imagenes_ingles_y_espanol, frases_data.size(), total_frames);
 
 
     return 0;
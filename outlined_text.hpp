@@ -0,0 +1,46 @@
+#pragma once
+
+// Outlined text compositing shared by frame_io.hpp's labels and the prueba*.cpp label
+// prototypes. Kept apart from frame_io.hpp because the prototypes define their own style
+// constants under the same names as the production ones.
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <cmath>
+
+// Composites outlined text given its coverage (0-255, the size of roi) in one pass. Matches
+// drawing the text in outlineColor at every offset of a (2t+1)x(2t+1) grid and the fill on
+// top: each pass covers what is left by its coverage a, so the outline opacity is
+// 1 - prod(1 - a). In terms of -ln(1 - a) the product becomes a sum over the window, which
+// boxFilter computes separably.
+inline void compositeOutlinedText(cv::Mat& roi, const cv::Mat& coverage, const cv::Scalar& textColor, const cv::Scalar& outlineColor, int outlineThickness) {
+    CV_Assert(roi.type() == CV_8UC3 && coverage.type() == CV_8UC1 && roi.size() == coverage.size());
+    static const cv::Mat minusLogTransparency = []() {
+        cv::Mat table(1, 256, CV_32F);
+        for (int a = 0; a < 256; ++a) {
+            table.at<float>(0, a) = a < 255 ? static_cast<float>(-std::log(1.0 - a / 255.0)) : 8.0f; // 8: opaque
+        }
+        return table;
+    }();
+    cv::Mat terms, sums;
+    cv::LUT(coverage, minusLogTransparency, terms);
+    const int window = 2 * outlineThickness + 1;
+    cv::boxFilter(terms, sums, CV_32F, cv::Size(window, window), cv::Point(-1, -1), false, cv::BORDER_CONSTANT);
+    sums -= terms; // The unshifted pass is the fill, not part of the outline
+
+    for (int y = 0; y < roi.rows; ++y) {
+        cv::Vec3b* pixel = roi.ptr<cv::Vec3b>(y);
+        const cv::uchar* fill = coverage.ptr<cv::uchar>(y);
+        const float* sum = sums.ptr<float>(y);
+        for (int x = 0; x < roi.cols; ++x) {
+            const int outlineAlpha = sum[x] > 0 ? cvRound(255.0 * (1.0 - std::exp(-sum[x]))) : 0;
+            const int fillAlpha = fill[x];
+            if (outlineAlpha == 0 && fillAlpha == 0) continue;
+            for (int c = 0; c < 3; ++c) {
+                int value = (static_cast<int>(outlineColor[c]) * outlineAlpha + pixel[x][c] * (255 - outlineAlpha) + 127) / 255;
+                value = (static_cast<int>(textColor[c]) * fillAlpha + value * (255 - fillAlpha) + 127) / 255;
+                pixel[x][c] = static_cast<cv::uchar>(value);
+            }
+        }
+    }
+}
@@ -13,6 +13,8 @@
 #include <cctype>      // For isspace
 #include <sys/stat.h>  // For stat() to check directory existence
 
+#include "outlined_text.hpp" // compositeOutlinedText
+
 using namespace cv;
 using namespace std;
 
@@ -119,24 +121,36 @@ void drawWrappedTextWithOutline(
     // Calcular la posición inicial Y para centrar el bloque de texto verticalmente dentro del rectángulo
     int current_line_y_start = rect.y + PADDING_VERTICAL + ( (rect.height - (2 * PADDING_VERTICAL) - totalRenderedTextHeight) / 2 );
     
+    // Posicion de cada linea y mascara de cobertura que las cubre todas con margen para el
+    // contorno: el rectangulo y ademas lo que una linea dibuje fuera de el (una palabra mas ancha
+    // que el rectangulo), con media altura de fuente a los lados por los glifos que se salen de la
+    // caja de getTextSize. Solo se recorta a la imagen, como cuando cada pasada de putText
+    // dibujaba directamente sobre ella.
+    vector<Point> origins;
+    Rect area(rect.x - outlineThickness, rect.y - outlineThickness, rect.width + 2 * outlineThickness, rect.height + 2 * outlineThickness);
     for (const string& line : lines) {
         Size lineSize = ft2->getTextSize(line, fontHeight, -1, nullptr);
         int line_x_initial = rect.x + PADDING_HORIZONTAL + (text_area_width - lineSize.width) / 2;
         int baseline_y_initial = current_line_y_start + singleLineRenderHeight;
-        
-        // Dibuja el contorno
-        // Se itera alrededor del punto central para crear el "stroke"
-        for (int i = -outlineThickness; i <= outlineThickness; ++i) {
-            for (int j = -outlineThickness; j <= outlineThickness; ++j) {
-                if (i == 0 && j == 0) continue; // Omite el centro, donde irá el texto principal
-                ft2->putText(img, line, Point(line_x_initial + j, baseline_y_initial + i), fontHeight, outlineColor, -1, LINE_AA, true);
-            }
-        }
-        // Dibuja el texto principal en el centro
-        ft2->putText(img, line, Point(line_x_initial, baseline_y_initial), fontHeight, textColor, -1, LINE_AA, true);
-
+        origins.push_back(Point(line_x_initial, baseline_y_initial));
+        area |= Rect(line_x_initial - fontHeight / 2 - outlineThickness, baseline_y_initial - fontHeight - outlineThickness,
+                     lineSize.width + fontHeight + 2 * outlineThickness, fontHeight * 3 / 2 + 2 * outlineThickness);
         current_line_y_start += singleLineRenderHeight; // Mover a la siguiente línea
     }
+    area &= Rect(0, 0, img.cols, img.rows);
+    if (area.empty()) return;
+
+    // Se dibuja en tres canales porque el putText de FreeType no admite un solo canal en todas
+    // las versiones.
+    Mat coverage_bgr = Mat::zeros(area.size(), CV_8UC3);
+    for (size_t i = 0; i < lines.size(); ++i) {
+        ft2->putText(coverage_bgr, lines[i], origins[i] - area.tl(), fontHeight, Scalar::all(255), -1, LINE_AA, true);
+    }
+
+    Mat coverage;
+    extractChannel(coverage_bgr, coverage, 0);
+    Mat roi = img(area);
+    compositeOutlinedText(roi, coverage, textColor, outlineColor, outlineThickness);
 }
 
 